@@ -0,0 +1,56 @@
+#include "Context.h"
+#include <cstdint>
+
+// the default control words: all the floating point exceptions masked, round to nearest.
+#define DEFAULT_MXCSR 0x1F80
+#define DEFAULT_FPU_CW 0x037F
+// the callee saved registers: rbp, rbx, r12, r13, r14, r15.
+#define SAVED_REGISTERS 6
+
+/* code for 64 bit Intel arch */
+asm (R"(
+    .text
+    .globl swap_context
+    .type swap_context, @function
+swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq (%rsi), %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size swap_context, .-swap_context
+)");
+
+/**
+ * builds the stack that swap_context expects, as if entryPoint had called it: the control words,
+ * the registers (all zero) and the return address, which is entryPoint itself.
+ */
+void init_context (Context *context, char *stack, size_t stackSize, void (*entryPoint) ())
+{
+    uintptr_t top = ((uintptr_t) stack + stackSize) & ~(uintptr_t) 15;
+    // after the ret into entryPoint the stack is aligned like right after a call: 8 mod 16.
+    uint64_t *frame = (uint64_t *) (top - 16) - SAVED_REGISTERS - 1;
+    frame[0] = DEFAULT_MXCSR | ((uint64_t) DEFAULT_FPU_CW << 32);
+    for (int i = 1; i <= SAVED_REGISTERS; ++i)
+    {
+        frame[i] = 0;
+    }
+    frame[SAVED_REGISTERS + 1] = (uint64_t) entryPoint;
+    context->sp = frame;
+}
@@ -0,0 +1,27 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+#include <cstddef>
+
+/**
+ * the saved registers of a thread that switched out. swap_context pushes them on the stack of the
+ * thread itself, so only its stack pointer is kept here.
+ */
+struct Context {
+    void *sp;
+};
+
+/**
+ * saves the callee saved registers (and the sse / x87 control words) of the calling thread into
+ * from, and continues the thread saved in to. No system call is made: the signal mask is left
+ * as it is. Returns when another thread swaps back into from.
+ * (code for 64 bit Intel arch)
+ */
+extern "C" void swap_context (Context *from, Context *to);
+
+/**
+ * initializes context so that the first swap_context into it calls entryPoint on the given stack.
+ * entryPoint must never return.
+ */
+void init_context (Context *context, char *stack, size_t stackSize, void (*entryPoint) ());
+
+#endif //CONTEXT_H
@@ -0,0 +1,227 @@
+#include "Reactor.h"
+#include "Thread.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+ * constructor of a reactor with no epoll instance yet.
+ */
+Reactor::Reactor () : _epollFd (-1), _wakeFd (-1), _waiting (0)
+{}
+
+/**
+ * true if some thread waits for I/O.
+ */
+bool Reactor::waiting () const
+{
+    return _waiting > 0;
+}
+
+/**
+ * makes a thread wait until fd is ready for reading (or writing, if write).
+ * @return 0 on success, -1 if fd cannot be waited on (errno is set, and the thread does not wait).
+ */
+int Reactor::wait (Thread *thread, int fd, bool write)
+{
+    if (fd < 0)
+    {
+        errno = EBADF;
+        return -1;
+    }
+    if (_epollFd < 0 && open ())
+    {
+        return -1;
+    }
+    if ((size_t) fd >= _fds.size ())
+    {
+        _fds.resize (fd + 1);
+    }
+    FdWaiters &waiters = _fds[fd];
+    (write ? waiters.writers : waiters.readers).push_back (thread);
+    thread->_ioFd = fd;
+    thread->_ioWrite = write;
+    _waiting++;
+    if (arm (fd))
+    {
+        int error = errno;
+        remove (thread);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * stops a thread from waiting, if it waits. (its fd stays registered, the event it may still
+ * report is ignored.)
+ */
+void Reactor::remove (Thread *thread)
+{
+    if (thread->_ioFd < 0)
+    {
+        return;
+    }
+    FdWaiters &waiters = _fds[thread->_ioFd];
+    std::vector<Thread *> &list = thread->_ioWrite ? waiters.writers : waiters.readers;
+    list.erase (std::find (list.begin (), list.end (), thread));
+    thread->_ioFd = -1;
+    _waiting--;
+}
+
+/**
+ * waits for events, like epoll_wait (a signal ends the wait with no events).
+ * @return the number of events, or -1 on failure.
+ */
+int Reactor::poll (struct epoll_event *events, int maxEvents, int timeoutMs)
+{
+    int count = epoll_wait (_epollFd, events, maxEvents, timeoutMs);
+    if (count < 0 && errno == EINTR)
+    {
+        return 0;
+    }
+    return count;
+}
+
+/**
+ * ends the wait of the threads whose I/O an event reports, and adds them to woken: the first
+ * thread that waits for the direction that is ready (if it does not use up the I/O, the fd is
+ * still ready when it is armed again, and the next thread is woken up by the next poll), or
+ * every thread of the fd on an error or a hang up (their system calls then report it).
+ */
+void Reactor::dispatch (const struct epoll_event *events, int count, std::vector<Thread *> &woken)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        int fd = events[i].data.fd;
+        if (fd == _wakeFd)
+        {
+            uint64_t value;
+            while (read (_wakeFd, &value, sizeof (value)) > 0)
+            {}
+            continue;
+        }
+        if ((size_t) fd >= _fds.size ())
+        {
+            continue;
+        }
+        FdWaiters &waiters = _fds[fd];
+        bool all = events[i].events & (EPOLLERR | EPOLLHUP);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+        {
+            take (waiters.readers, 1, woken);
+        }
+        if (events[i].events & EPOLLOUT)
+        {
+            take (waiters.writers, 1, woken);
+        }
+        if (all)
+        {
+            take (waiters.readers, waiters.readers.size (), woken);
+            take (waiters.writers, waiters.writers.size (), woken);
+        }
+        // the event disarmed the fd: it is armed again for the threads that still wait, or if
+        // that fails they try their system call again and see why.
+        if (arm (fd))
+        {
+            take (waiters.readers, waiters.readers.size (), woken);
+            take (waiters.writers, waiters.writers.size (), woken);
+        }
+    }
+}
+
+/**
+ * wakes up a worker that sleeps in poll (a wake up with no sleeping worker ends its next poll).
+ */
+void Reactor::wake ()
+{
+    uint64_t one = 1;
+    if (_wakeFd >= 0 && write (_wakeFd, &one, sizeof (one)) < 0)
+    {
+        // the counter is full, so a wake up is pending anyway.
+    }
+}
+
+/**
+ * creates the epoll instance and its wake up eventfd.
+ * @return 0 on success, -1 on failure (errno is set).
+ */
+int Reactor::open ()
+{
+    _epollFd = epoll_create1 (EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+    {
+        return -1;
+    }
+    _wakeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = _wakeFd;
+    if (_wakeFd < 0 || epoll_ctl (_epollFd, EPOLL_CTL_ADD, _wakeFd, &event))
+    {
+        int error = errno;
+        if (_wakeFd >= 0)
+        {
+            close (_wakeFd);
+        }
+        close (_epollFd);
+        _epollFd = -1;
+        _wakeFd = -1;
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * registers fd for the directions its threads wait for, until its next event. Registers it anew
+ * if it is not in the epoll instance (the first wait on it, or it was closed and its number
+ * reused since).
+ * @return 0 on success (or if no thread waits on fd), -1 on failure (errno is set).
+ */
+int Reactor::arm (int fd)
+{
+    const FdWaiters &waiters = _fds[fd];
+    if (waiters.readers.empty () && waiters.writers.empty ())
+    {
+        return 0;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLONESHOT;
+    if (!waiters.readers.empty ())
+    {
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (!waiters.writers.empty ())
+    {
+        event.events |= EPOLLOUT;
+    }
+    event.data.fd = fd;
+    if (epoll_ctl (_epollFd, EPOLL_CTL_MOD, fd, &event) == 0)
+    {
+        return 0;
+    }
+    if (errno != ENOENT)
+    {
+        return -1;
+    }
+    return epoll_ctl (_epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/**
+ * ends the wait of the first count threads of a list (or all, if it has fewer), and adds them
+ * to woken.
+ */
+void Reactor::take (std::vector<Thread *> &waiters, size_t count, std::vector<Thread *> &woken)
+{
+    count = std::min (count, waiters.size ());
+    for (size_t i = 0; i < count; ++i)
+    {
+        waiters[i]->_ioFd = -1;
+        woken.push_back (waiters[i]);
+    }
+    waiters.erase (waiters.begin (), waiters.begin () + count);
+    _waiting -= (int) count;
+}
@@ -0,0 +1,51 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+#include <vector>
+#include <sys/epoll.h>
+
+class Thread;
+
+/**
+ * the threads that wait for I/O (see uthreads_io.h), by the fd they wait on, and an epoll
+ * instance that tells when the fds are ready. The library polls it at every scheduling point,
+ * and an idle worker sleeps in it.
+ * an fd is registered with EPOLLONESHOT for the directions its threads wait for, and registered
+ * again (epoll_ctl) every time a thread starts to wait on it. Level triggered, so I/O that became
+ * ready between the failed system call of a thread and the registration is reported too.
+ * the epoll instance is created by the first wait, so a program that does no I/O pays nothing.
+ * nothing here is thread safe: the library calls it with the scheduler locked, except poll.
+ */
+class Reactor {
+
+public:
+    Reactor ();
+    bool waiting () const;
+    int wait (Thread *thread, int fd, bool write);
+    void remove (Thread *thread);
+    int poll (struct epoll_event *events, int maxEvents, int timeoutMs);
+    void dispatch (const struct epoll_event *events, int count, std::vector<Thread *> &woken);
+    void wake ();
+
+private:
+    /**
+     * the threads that wait on one fd.
+     */
+    struct FdWaiters {
+        std::vector<Thread *> readers;
+        std::vector<Thread *> writers;
+    };
+
+    int open ();
+    int arm (int fd);
+    void take (std::vector<Thread *> &waiters, size_t count, std::vector<Thread *> &woken);
+
+    int _epollFd;
+    // an eventfd in the epoll instance, written to wake up a worker that sleeps in poll.
+    int _wakeFd;
+    // indexed by fd.
+    std::vector<FdWaiters> _fds;
+    // the number of threads that wait.
+    int _waiting;
+};
+
+#endif //REACTOR_H
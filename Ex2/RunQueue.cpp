@@ -0,0 +1,293 @@
+#include "RunQueue.h"
+#include "Thread.h"
+
+// the weight of a thread of DEFAULT_PRIORITY.
+#define DEFAULT_WEIGHT 1024
+
+/**
+ * the weights of the priorities under POLICY_FAIR: each priority gets about 1.5 times the cpu of
+ * the next one (the weights of every second nice level of Linux, from -8 to 6).
+ */
+static const uint64_t PRIORITY_WEIGHTS[NUM_PRIORITIES] = {6100, 3906, 2501, 1586, 1024, 655, 423, 272};
+
+RunQueue::~RunQueue ()
+{}
+
+/**
+ * true if a thread that just became ready should preempt the running thread right away.
+ * (by default never: it waits for the end of the quantum.)
+ */
+bool RunQueue::preempts (const Thread *ready, const Thread *running) const
+{
+    return false;
+}
+
+/**
+ * charges a thread of this queue for ns nanoseconds of running time (only the fair policy counts it).
+ */
+void RunQueue::charge (Thread *thread, uint64_t ns)
+{}
+
+/**
+ * called when the worker of this queue steals a thread from another queue: the thread comes back
+ * to this queue when it switches out.
+ */
+void RunQueue::adopt (Thread *thread, const RunQueue *from)
+{}
+
+/**
+ * empties the queue (the threads themselves are not deleted).
+ */
+void RunQueue::clear ()
+{
+    while (!empty ())
+    {
+        pop ();
+    }
+}
+
+/**
+ * removes a thread from whatever run queue it is in, if any.
+ */
+void RunQueue::unlink (Thread *thread)
+{
+    if (thread->_runQueue != nullptr)
+    {
+        thread->_runQueue->remove (thread);
+    }
+}
+
+/**
+ * creates an empty run queue of a policy (nullptr for an unknown policy).
+ */
+RunQueue *RunQueue::create (SchedPolicy policy, int quantum_usecs)
+{
+    switch (policy)
+    {
+        case POLICY_ROUND_ROBIN:
+            return new RoundRobinQueue ();
+        case POLICY_PRIORITY:
+            return new PriorityQueue ();
+        case POLICY_FAIR:
+            return new FairQueue ((uint64_t) quantum_usecs * 1000);
+    }
+    return nullptr;
+}
+
+void RunQueue::setRunQueue (Thread *thread, RunQueue *queue)
+{
+    thread->_runQueue = queue;
+}
+
+bool RoundRobinQueue::empty () const
+{
+    return _queue.empty ();
+}
+
+void RoundRobinQueue::push (Thread *thread)
+{
+    _queue.pushBack (thread);
+    setRunQueue (thread, this);
+}
+
+Thread *RoundRobinQueue::pop ()
+{
+    Thread *thread = _queue.popFront ();
+    if (thread != nullptr)
+    {
+        setRunQueue (thread, nullptr);
+    }
+    return thread;
+}
+
+void RoundRobinQueue::remove (Thread *thread)
+{
+    _queue.remove (thread);
+    setRunQueue (thread, nullptr);
+}
+
+bool PriorityQueue::empty () const
+{
+    for (const ThreadQueue &level : _levels)
+    {
+        if (!level.empty ())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PriorityQueue::push (Thread *thread)
+{
+    _levels[thread->getPriority ()].pushBack (thread);
+    setRunQueue (thread, this);
+}
+
+Thread *PriorityQueue::pop ()
+{
+    for (ThreadQueue &level : _levels)
+    {
+        if (!level.empty ())
+        {
+            Thread *thread = level.popFront ();
+            setRunQueue (thread, nullptr);
+            return thread;
+        }
+    }
+    return nullptr;
+}
+
+void PriorityQueue::remove (Thread *thread)
+{
+    // the thread is in the level of its priority (the priority of a queued thread never changes).
+    _levels[thread->getPriority ()].remove (thread);
+    setRunQueue (thread, nullptr);
+}
+
+/**
+ * a thread of a higher priority preempts the running thread.
+ */
+bool PriorityQueue::preempts (const Thread *ready, const Thread *running) const
+{
+    return ready->getPriority () < running->getPriority ();
+}
+
+/**
+ * constructor of an empty queue.
+ * @param quantumNs the quantum of the library, which the sleeper credit and the wake up
+ * granularity are measured in.
+ */
+FairQueue::FairQueue (uint64_t quantumNs) : _minVruntime (0), _sleeperCredit (quantumNs),
+                                            _wakeupGranularity (quantumNs / 2)
+{}
+
+bool FairQueue::empty () const
+{
+    return _heap.empty ();
+}
+
+/**
+ * adds a thread by its virtual runtime. A thread that did not run for a while (it slept, was
+ * blocked or is new) is first moved up to _sleeperCredit behind the queue.
+ */
+void FairQueue::push (Thread *thread)
+{
+    if (thread->_vruntime + _sleeperCredit < _minVruntime)
+    {
+        thread->_vruntime = _minVruntime - _sleeperCredit;
+    }
+    _heap.push_back ({thread->_vruntime, thread});
+    thread->_runIndex = (int) _heap.size () - 1;
+    siftUp (_heap.size () - 1);
+    setRunQueue (thread, this);
+}
+
+Thread *FairQueue::pop ()
+{
+    if (_heap.empty ())
+    {
+        return nullptr;
+    }
+    Thread *thread = _heap.front ().thread;
+    remove (thread);
+    if (thread->_vruntime > _minVruntime)
+    {
+        _minVruntime = thread->_vruntime;
+    }
+    return thread;
+}
+
+void FairQueue::remove (Thread *thread)
+{
+    if (thread->_runIndex < 0)
+    {
+        return;
+    }
+    size_t index = (size_t) thread->_runIndex;
+    Entry last = _heap.back ();
+    _heap.pop_back ();
+    thread->_runIndex = -1;
+    setRunQueue (thread, nullptr);
+    if (index < _heap.size ())
+    {
+        // the last thread takes the place of the removed one, and moves up or down from there.
+        place (index, last);
+        siftUp (index);
+        siftDown ((size_t) last.thread->_runIndex);
+    }
+}
+
+/**
+ * a ready thread preempts the running thread if that one ran more than _wakeupGranularity
+ * (of virtual runtime) longer than it.
+ */
+bool FairQueue::preempts (const Thread *ready, const Thread *running) const
+{
+    return ready->_vruntime + _wakeupGranularity < running->_vruntime;
+}
+
+/**
+ * adds the running time to the virtual runtime, scaled by the weight of the priority.
+ */
+void FairQueue::charge (Thread *thread, uint64_t ns)
+{
+    thread->_vruntime += ns * DEFAULT_WEIGHT / PRIORITY_WEIGHTS[thread->getPriority ()];
+}
+
+/**
+ * the virtual runtimes of two queues are unrelated, so a stolen thread keeps its distance from the
+ * queue it came from.
+ */
+void FairQueue::adopt (Thread *thread, const RunQueue *from)
+{
+    uint64_t fromMin = static_cast<const FairQueue *> (from)->_minVruntime;
+    uint64_t lead = thread->_vruntime > fromMin ? thread->_vruntime - fromMin : 0;
+    thread->_vruntime = _minVruntime + lead;
+}
+
+void FairQueue::place (size_t index, const Entry &entry)
+{
+    _heap[index] = entry;
+    entry.thread->_runIndex = (int) index;
+}
+
+void FairQueue::siftUp (size_t index)
+{
+    Entry entry = _heap[index];
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (_heap[parent].vruntime <= entry.vruntime)
+        {
+            break;
+        }
+        place (index, _heap[parent]);
+        index = parent;
+    }
+    place (index, entry);
+}
+
+void FairQueue::siftDown (size_t index)
+{
+    Entry entry = _heap[index];
+    while (true)
+    {
+        size_t child = 2 * index + 1;
+        if (child >= _heap.size ())
+        {
+            break;
+        }
+        if (child + 1 < _heap.size () && _heap[child + 1].vruntime < _heap[child].vruntime)
+        {
+            child++;
+        }
+        if (entry.vruntime <= _heap[child].vruntime)
+        {
+            break;
+        }
+        place (index, _heap[child]);
+        index = child;
+    }
+    place (index, entry);
+}
@@ -0,0 +1,103 @@
+#ifndef RUNQUEUE_H
+#define RUNQUEUE_H
+#include <vector>
+#include <cstdint>
+#include "uthreads_ext.h"
+#include "ThreadQueue.h"
+
+class Thread;
+
+/**
+ * the READY threads of a worker, in the order its scheduling policy runs them.
+ * A ready thread is in exactly one run queue and remembers it, so it can be removed from
+ * wherever it is (RunQueue::unlink).
+ */
+class RunQueue {
+
+public:
+    virtual ~RunQueue ();
+    virtual bool empty () const = 0;
+    // adds a thread (that is in no run queue).
+    virtual void push (Thread *thread) = 0;
+    // removes the thread that runs next and returns it (nullptr if the queue is empty).
+    virtual Thread *pop () = 0;
+    // removes a thread from the queue, if it is in it.
+    virtual void remove (Thread *thread) = 0;
+    virtual bool preempts (const Thread *ready, const Thread *running) const;
+    virtual void charge (Thread *thread, uint64_t ns);
+    virtual void adopt (Thread *thread, const RunQueue *from);
+    void clear ();
+    static void unlink (Thread *thread);
+    static RunQueue *create (SchedPolicy policy, int quantum_usecs);
+
+protected:
+    static void setRunQueue (Thread *thread, RunQueue *queue);
+};
+
+/**
+ * POLICY_ROUND_ROBIN: one FIFO queue.
+ */
+class RoundRobinQueue : public RunQueue {
+
+public:
+    bool empty () const override;
+    void push (Thread *thread) override;
+    Thread *pop () override;
+    void remove (Thread *thread) override;
+
+private:
+    ThreadQueue _queue;
+};
+
+/**
+ * POLICY_PRIORITY: a FIFO queue per priority, the highest priority first.
+ */
+class PriorityQueue : public RunQueue {
+
+public:
+    bool empty () const override;
+    void push (Thread *thread) override;
+    Thread *pop () override;
+    void remove (Thread *thread) override;
+    bool preempts (const Thread *ready, const Thread *running) const override;
+
+private:
+    ThreadQueue _levels[NUM_PRIORITIES];
+};
+
+/**
+ * POLICY_FAIR: a binary min-heap of the threads keyed on their virtual runtime, like SleepHeap
+ * (the keys are kept in the heap too: the virtual runtime of a queued thread does not change).
+ */
+class FairQueue : public RunQueue {
+
+public:
+    explicit FairQueue (uint64_t quantumNs);
+    bool empty () const override;
+    void push (Thread *thread) override;
+    Thread *pop () override;
+    void remove (Thread *thread) override;
+    bool preempts (const Thread *ready, const Thread *running) const override;
+    void charge (Thread *thread, uint64_t ns) override;
+    void adopt (Thread *thread, const RunQueue *from) override;
+
+private:
+    struct Entry {
+        uint64_t vruntime;
+        Thread *thread;
+    };
+
+    void place (size_t index, const Entry &entry);
+    void siftUp (size_t index);
+    void siftDown (size_t index);
+
+    std::vector<Entry> _heap;
+    // the virtual runtime of the last thread popped, it never goes back.
+    uint64_t _minVruntime;
+    // how far behind _minVruntime a thread that slept is placed.
+    uint64_t _sleeperCredit;
+    // how far ahead the running thread must be for a ready thread to preempt it.
+    uint64_t _wakeupGranularity;
+};
+
+#endif //RUNQUEUE_H
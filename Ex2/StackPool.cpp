@@ -0,0 +1,132 @@
+#include "StackPool.h"
+#include "uthreads.h"
+#include <sys/mman.h>
+#include <sys/auxv.h>
+#include <csignal>
+#include <unistd.h>
+
+// the stacks mapped at once when the pool is empty.
+#define STACKS_PER_MAPPING 64
+
+// a guard region (Linux 6.13) faults like a PROT_NONE page without splitting the mapping.
+#ifndef MADV_GUARD_INSTALL
+#define MADV_GUARD_INSTALL 102
+#endif
+
+// the signal frames a stack has room for on top of STACK_SIZE: the timer signal, and one more
+// that arrives before the handler switches the thread out.
+#define SIGNAL_FRAMES 2
+
+/**
+ * constructor of an empty pool.
+ */
+StackPool::StackPool ()
+{
+    _pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    // a signal frame holds the whole vector register state, which is most of a page or more on
+    // recent cpus: the thread itself still gets STACK_SIZE bytes.
+    size_t frameBytes = (size_t) getauxval (AT_MINSIGSTKSZ);
+    if (frameBytes < (size_t) MINSIGSTKSZ)
+    {
+        frameBytes = MINSIGSTKSZ;
+    }
+    size_t bytes = STACK_SIZE + SIGNAL_FRAMES * frameBytes;
+    _stackBytes = (bytes + _pageSize - 1) / _pageSize * _pageSize;
+}
+
+/**
+ * the size of every stack of the pool: STACK_SIZE, and room for the signal frames.
+ */
+size_t StackPool::stackBytes () const
+{
+    return _stackBytes;
+}
+
+/**
+ * returns a stack of at least STACK_SIZE bytes (its lowest address), a released one if there is
+ * any. On failure returns nullptr.
+ */
+char *StackPool::acquire ()
+{
+    if (_free.empty () && !mapStacks ())
+    {
+        return nullptr;
+    }
+    char *stack = _free.back ();
+    _free.pop_back ();
+    return stack;
+}
+
+/**
+ * gives a stack back to the pool, for the next spawned thread.
+ */
+void StackPool::release (char *stack)
+{
+    _free.push_back (stack);
+}
+
+/**
+ * makes a page of a mapping a guard page. A PROT_NONE page splits the mapping in the kernel, and
+ * a process has a limited number of mappings (vm.max_map_count, 65530 by default), which would
+ * limit the threads to about half of it; a guard region does not, so it is used when the kernel
+ * has it.
+ * @return 0 on success, -1 on failure.
+ */
+static int guard_page (char *page, size_t pageSize)
+{
+    if (madvise (page, pageSize, MADV_GUARD_INSTALL) == 0)
+    {
+        return 0;
+    }
+    return mprotect (page, pageSize, PROT_NONE);
+}
+
+/**
+ * maps STACKS_PER_MAPPING stacks, each with a guard page under it, and adds them to the pool.
+ * @return true on success, false if the mapping failed.
+ */
+bool StackPool::mapStacks ()
+{
+    size_t slotBytes = _pageSize + _stackBytes;
+    void *mapping = mmap (nullptr, STACKS_PER_MAPPING * slotBytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    // the stacks grow down, so the guard page of every stack is the lowest page of its slot.
+    // they are pushed from the top so the lowest stack is given first.
+    for (int i = STACKS_PER_MAPPING - 1; i >= 0; --i)
+    {
+        char *slot = (char *) mapping + i * slotBytes;
+        if (guard_page (slot, _pageSize))
+        {
+            // the stacks above are in the pool already, only the rest is unmapped.
+            munmap (mapping, (i + 1) * slotBytes);
+            return !_free.empty ();
+        }
+        _free.push_back (slot + _pageSize);
+    }
+    return true;
+}
+
+/**
+ * maps a stack with a guard page under it (used for the scheduler stack of worker 0).
+ */
+char *map_stack (size_t bytes)
+{
+    size_t pageSize = (size_t) sysconf (_SC_PAGESIZE);
+    void *mapping = mmap (nullptr, pageSize + bytes, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    // the stack grows down, so the guard page is the lowest page of the mapping.
+    if (guard_page ((char *) mapping, pageSize))
+    {
+        munmap (mapping, pageSize + bytes);
+        return nullptr;
+    }
+    return (char *) mapping + pageSize;
+}
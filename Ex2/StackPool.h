@@ -0,0 +1,38 @@
+#ifndef STACKPOOL_H
+#define STACKPOOL_H
+#include <vector>
+#include <cstddef>
+
+/**
+ * the stacks of the threads. The stacks are mapped with mmap STACKS_PER_MAPPING at a time, each
+ * with a guard page under it, so a thread that overflows its stack gets a SIGSEGV instead of
+ * corrupting the heap or the stack under it.
+ * released stacks are kept and given to the next spawned threads, so spawn and terminate
+ * usually do no system call at all.
+ * the stacks are never unmapped: a thread that terminates itself (or the whole process) still
+ * runs on its stack after releasing it.
+ */
+class StackPool {
+
+public:
+    StackPool ();
+    char *acquire ();
+    void release (char *stack);
+    size_t stackBytes () const;
+
+private:
+    bool mapStacks ();
+
+    size_t _pageSize;
+    // STACK_SIZE and room for signal frames, rounded up to whole pages.
+    size_t _stackBytes;
+    std::vector<char *> _free;
+};
+
+/**
+ * maps a stack of the given size (a multiple of the page size) with a guard page under it.
+ * @return the lowest address of the stack, or nullptr on failure.
+ */
+char *map_stack (size_t bytes);
+
+#endif //STACKPOOL_H
@@ -1,63 +1,63 @@
 #include "Thread.h"
-#include <csignal>
-
-/* code for 64 bit Intel arch */
-typedef unsigned long address_t;
-#define JB_SP 6
-#define JB_PC 7
-
-/* A translation is required when using an address of a variable.
-   Use this as a black box in your code. */
-address_t translate_address(address_t addr)
-{
-    address_t ret;
-    asm volatile("xor    %%fs:0x30,%0\n"
-                 "rol    $0x11,%0\n"
-                 : "=g" (ret)
-                 : "0" (addr));
-    return ret;
-}
 
 /**
  * constructor
+ * @param id the id of the thread.
  * @param entryPoint the start address for the thread function.
+ * @param stack the lowest address of a stack of STACK_SIZE bytes (the thread does not own it).
  */
-Thread::Thread (thread_entry_point entryPoint)
+Thread::Thread (int id, thread_entry_point entryPoint, char *stack)
 {
+    _id = id;
     _entryPoint = entryPoint;
-    _threadStack = new char[STACK_SIZE];
+    _threadStack = stack;
     _quantumCounter = 0;
     _state = READY;
-
-    // initializes env to use the right stack, and to run from the function 'entry_point', when we'll use
-    // siglongjmp to jump into the thread.
-    address_t sp = (address_t) this->_threadStack + STACK_SIZE - sizeof(address_t);
-    auto pc = (address_t) _entryPoint;
-    sigsetjmp(_env, 1);
-    (_env->__jmpbuf)[JB_SP] = translate_address(sp);
-    (_env->__jmpbuf)[JB_PC] = translate_address(pc);
-    sigemptyset(&_env->__saved_mask);
 };
 
 /**
  * constructor only for main thread
  */
 Thread::Thread() {
+    _entryPoint = nullptr;
     _quantumCounter = 1;
     _state = RUNNING;
-    sigsetjmp((_env), 1);
-    sigemptyset(&(_env)->__saved_mask);
+    // the main thread runs on the stack of the process, its context is saved when it switches out.
+    _context.sp = nullptr;
 }
 
 /**
- * destructor
+ * destructor (the stack is given back to the stack pool by the library).
  */
 Thread::~Thread ()
 {
-    delete[] _threadStack;
     _threadStack = nullptr;
 }
 
+/**
+ * Getter for the thread id.
+ */
+int Thread::getId () const
+{
+    return _id;
+}
+
+/**
+ * Getter for the thread stack (nullptr for the main thread).
+ */
+char *Thread::getStack () const
+{
+    return _threadStack;
+}
+
+/**
+ * Getter for the start address of the thread function.
+ */
+thread_entry_point Thread::getEntryPoint () const
+{
+    return _entryPoint;
+}
+
 /**
  * Getter for num of quantums.
  */
@@ -74,6 +74,14 @@ void Thread::incQuantums ()
     _quantumCounter++;
 }
 
+/**
+ * adds quantums the thread started without being switched (tickless mode).
+ */
+void Thread::addQuantums (unsigned int quantums)
+{
+    _quantumCounter += quantums;
+}
+
 /**
  * Getter for the thread state.
  */
@@ -83,27 +91,35 @@ ThreadState Thread::getState ()
 }
 
 /**
- * Getter for the thread sleep time.
+ * true while the thread is in the sleep heap.
  */
-int Thread::getSleepTime () const
+bool Thread::isSleeping () const
 {
-    return _sleepTime;
+    return _heapIndex >= 0;
 }
 
 /**
- * decrement the quantums time by 1.
+ * true while the thread waits for I/O in the reactor.
  */
-void Thread::decSleepTime ()
+bool Thread::isWaitingIo () const
 {
-    _sleepTime--;
+    return _ioFd >= 0;
 }
 
 /**
- * Setter for the thread sleep time.
+ * Getter for the quantum the thread wakes up in.
  */
-void Thread::setSleepTime (int num_quantums)
+int Thread::getWakeQuantum () const
 {
-    _sleepTime = num_quantums;
+    return _wakeQuantum;
+}
+
+/**
+ * Setter for the quantum the thread wakes up in (set before it goes into the sleep heap).
+ */
+void Thread::setWakeQuantum (int quantum)
+{
+    _wakeQuantum = quantum;
 }
 
 /**
@@ -113,3 +129,59 @@ void Thread::setState (ThreadState state)
 {
     _state = state;
 }
+
+/**
+ * Getter for the request another thread made of this thread.
+ */
+ThreadRequest Thread::getRequest () const
+{
+    return _request;
+}
+
+/**
+ * Setter for the request another thread made of this thread.
+ */
+void Thread::setRequest (ThreadRequest request)
+{
+    _request = request;
+}
+
+/**
+ * Getter for the priority of the thread (0 is the highest).
+ */
+int Thread::getPriority () const
+{
+    return _priority;
+}
+
+/**
+ * Setter for the priority of the thread (only while it is in no run queue).
+ */
+void Thread::setPriority (int priority)
+{
+    _priority = priority;
+}
+
+/**
+ * Getter for the length of the quanta of the thread (0 for the quantum of the library).
+ */
+int Thread::getQuantumUsecs () const
+{
+    return _quantumUsecs;
+}
+
+/**
+ * Setter for the length of the quanta of the thread.
+ */
+void Thread::setQuantumUsecs (int quantumUsecs)
+{
+    _quantumUsecs = quantumUsecs;
+}
+
+/**
+ * Getter for the run queue the thread is in (nullptr if it is not READY).
+ */
+RunQueue *Thread::getRunQueue () const
+{
+    return _runQueue;
+}
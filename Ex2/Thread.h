@@ -1,5 +1,12 @@
+#ifndef THREAD_H
+#define THREAD_H
 #include "uthreads.h"
-#include <csetjmp>
+#include "uthreads_ext.h"
+#include "Context.h"
+#include <cstdint>
+
+class ThreadQueue;
+class RunQueue;
 
 /**
  * enum for the different thread states
@@ -8,7 +15,19 @@ enum ThreadState {
     READY,
     RUNNING,
     BLOCKED,
-    SLEEP_NOT_BLOCKED
+    SLEEP_NOT_BLOCKED,
+    // waits for I/O (see uthreads_io.h) and was not blocked.
+    IO_WAIT_NOT_BLOCKED
+};
+
+/**
+ * what another thread asked of a thread while it was running on another worker (M:N mode).
+ * the request is carried out when the thread switches out.
+ */
+enum ThreadRequest {
+    NO_REQUEST,
+    BLOCK_REQUEST,
+    TERMINATE_REQUEST
 };
 
 /**
@@ -17,28 +36,68 @@ enum ThreadState {
 class Thread {
 
 public:
-    sigjmp_buf _env;
-    // explicit: to prevent the compiler to cast a non thread_entry_point variable to be thread_entry_point.
-    // (happens in C++ automatically when a constructor has exactly one argument)
-    explicit Thread (thread_entry_point entryPoint);
+    // the registers of the thread while it is switched out (the library initializes it).
+    Context _context;
+    Thread (int id, thread_entry_point entryPoint, char *stack);
     Thread();
     ~Thread ();
+    int getId () const;
+    char *getStack () const;
+    thread_entry_point getEntryPoint () const;
     unsigned int getQuantums () const;
     void incQuantums ();
+    void addQuantums (unsigned int quantums);
     ThreadState getState ();
-    int getSleepTime () const;
-    void decSleepTime ();
-    void setSleepTime (int num_quantums);
+    bool isSleeping () const;
+    bool isWaitingIo () const;
+    int getWakeQuantum () const;
+    void setWakeQuantum (int quantum);
     void setState (ThreadState state);
+    ThreadRequest getRequest () const;
+    void setRequest (ThreadRequest request);
+    int getPriority () const;
+    void setPriority (int priority);
+    int getQuantumUsecs () const;
+    void setQuantumUsecs (int quantumUsecs);
+    RunQueue *getRunQueue () const;
 
 
 
 private:
+    // the queues keep their links inside the threads.
+    friend class ThreadQueue;
+    friend class SleepHeap;
+    friend class RunQueue;
+    friend class FairQueue;
+    friend class Reactor;
 
+    int _id = 0;
     thread_entry_point _entryPoint;
+    // the stack comes from the stack pool, and goes back to it when the thread is terminated.
     char *_threadStack = nullptr;
     unsigned int _quantumCounter = 1;
     ThreadState _state;
-    int _sleepTime = 0;
+    ThreadRequest _request = NO_REQUEST;
+    // the total quantum in which a sleeping thread wakes up.
+    int _wakeQuantum = 0;
+    // the queue (ready or blocked) the thread is in, and its neighbours there.
+    ThreadQueue *_queue = nullptr;
+    Thread *_queuePrev = nullptr;
+    Thread *_queueNext = nullptr;
+    // the index of the thread in the sleep heap, -1 if it does not sleep.
+    int _heapIndex = -1;
+    int _priority = DEFAULT_PRIORITY;
+    // the length of the quanta of the thread, 0 for the quantum of the library.
+    int _quantumUsecs = 0;
+    // the run queue the thread is in while it is READY.
+    RunQueue *_runQueue = nullptr;
+    // POLICY_FAIR: the weighted running time of the thread, and its index in the run queue heap.
+    uint64_t _vruntime = 0;
+    int _runIndex = -1;
+    // the fd the thread waits on in the reactor (for writing if _ioWrite), -1 if it does not wait.
+    int _ioFd = -1;
+    bool _ioWrite = false;
 
 };
+
+#endif //THREAD_H
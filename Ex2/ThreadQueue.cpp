@@ -0,0 +1,222 @@
+#include "ThreadQueue.h"
+#include "Thread.h"
+
+/**
+ * constructor of an empty queue.
+ */
+ThreadQueue::ThreadQueue () : _head (nullptr), _tail (nullptr), _size (0)
+{}
+
+bool ThreadQueue::empty () const
+{
+    return _head == nullptr;
+}
+
+size_t ThreadQueue::size () const
+{
+    return _size;
+}
+
+/**
+ * adds a thread (that is in no queue) to the end of the queue.
+ */
+void ThreadQueue::pushBack (Thread *thread)
+{
+    thread->_queue = this;
+    thread->_queuePrev = _tail;
+    thread->_queueNext = nullptr;
+    if (_tail != nullptr)
+    {
+        _tail->_queueNext = thread;
+    }
+    else
+    {
+        _head = thread;
+    }
+    _tail = thread;
+    _size++;
+}
+
+/**
+ * removes the first thread of the queue and returns it (nullptr if the queue is empty).
+ */
+Thread *ThreadQueue::popFront ()
+{
+    Thread *thread = _head;
+    if (thread != nullptr)
+    {
+        remove (thread);
+    }
+    return thread;
+}
+
+/**
+ * removes a thread from the queue, if it is in it.
+ */
+void ThreadQueue::remove (Thread *thread)
+{
+    if (thread->_queue != this)
+    {
+        return;
+    }
+    if (thread->_queuePrev != nullptr)
+    {
+        thread->_queuePrev->_queueNext = thread->_queueNext;
+    }
+    else
+    {
+        _head = thread->_queueNext;
+    }
+    if (thread->_queueNext != nullptr)
+    {
+        thread->_queueNext->_queuePrev = thread->_queuePrev;
+    }
+    else
+    {
+        _tail = thread->_queuePrev;
+    }
+    thread->_queue = nullptr;
+    thread->_queuePrev = nullptr;
+    thread->_queueNext = nullptr;
+    _size--;
+}
+
+/**
+ * removes a thread from whatever queue it is in, if any.
+ */
+void ThreadQueue::unlink (Thread *thread)
+{
+    if (thread->_queue != nullptr)
+    {
+        thread->_queue->remove (thread);
+    }
+}
+
+bool ThreadQueue::contains (const Thread *thread) const
+{
+    return thread->_queue == this;
+}
+
+/**
+ * empties the queue (the threads themselves are not deleted).
+ */
+void ThreadQueue::clear ()
+{
+    while (!empty ())
+    {
+        popFront ();
+    }
+}
+
+bool SleepHeap::empty () const
+{
+    return _heap.empty ();
+}
+
+/**
+ * adds a thread by its wake up quantum.
+ */
+void SleepHeap::push (Thread *thread)
+{
+    _heap.push_back ({thread->_wakeQuantum, thread});
+    thread->_heapIndex = (int) _heap.size () - 1;
+    siftUp (_heap.size () - 1);
+}
+
+/**
+ * the thread that wakes up first (the heap must not be empty).
+ */
+Thread *SleepHeap::top () const
+{
+    return _heap.front ().thread;
+}
+
+/**
+ * removes the thread that wakes up first and returns it (the heap must not be empty).
+ */
+Thread *SleepHeap::pop ()
+{
+    Thread *thread = _heap.front ().thread;
+    remove (thread);
+    return thread;
+}
+
+/**
+ * removes a thread from the heap, if it is in it.
+ */
+void SleepHeap::remove (Thread *thread)
+{
+    if (thread->_heapIndex < 0)
+    {
+        return;
+    }
+    size_t index = (size_t) thread->_heapIndex;
+    Entry last = _heap.back ();
+    _heap.pop_back ();
+    thread->_heapIndex = -1;
+    if (index < _heap.size ())
+    {
+        // the last thread takes the place of the removed one, and moves up or down from there.
+        place (index, last);
+        siftUp (index);
+        siftDown ((size_t) last.thread->_heapIndex);
+    }
+}
+
+/**
+ * empties the heap (the threads themselves are not deleted).
+ */
+void SleepHeap::clear ()
+{
+    for (const Entry &entry : _heap)
+    {
+        entry.thread->_heapIndex = -1;
+    }
+    _heap.clear ();
+}
+
+void SleepHeap::place (size_t index, const Entry &entry)
+{
+    _heap[index] = entry;
+    entry.thread->_heapIndex = (int) index;
+}
+
+void SleepHeap::siftUp (size_t index)
+{
+    Entry entry = _heap[index];
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (_heap[parent].wakeQuantum <= entry.wakeQuantum)
+        {
+            break;
+        }
+        place (index, _heap[parent]);
+        index = parent;
+    }
+    place (index, entry);
+}
+
+void SleepHeap::siftDown (size_t index)
+{
+    Entry entry = _heap[index];
+    while (true)
+    {
+        size_t child = 2 * index + 1;
+        if (child >= _heap.size ())
+        {
+            break;
+        }
+        if (child + 1 < _heap.size () && _heap[child + 1].wakeQuantum < _heap[child].wakeQuantum)
+        {
+            child++;
+        }
+        if (entry.wakeQuantum <= _heap[child].wakeQuantum)
+        {
+            break;
+        }
+        place (index, _heap[child]);
+        index = child;
+    }
+    place (index, entry);
+}
@@ -0,0 +1,60 @@
+#ifndef THREADQUEUE_H
+#define THREADQUEUE_H
+#include <vector>
+#include <cstddef>
+
+class Thread;
+
+/**
+ * an intrusive FIFO queue of threads: the links are kept in the threads themselves, so pushing,
+ * popping and removing any thread is O(1). A thread is in at most one queue at a time.
+ */
+class ThreadQueue {
+
+public:
+    ThreadQueue ();
+    bool empty () const;
+    size_t size () const;
+    void pushBack (Thread *thread);
+    Thread *popFront ();
+    void remove (Thread *thread);
+    bool contains (const Thread *thread) const;
+    void clear ();
+    static void unlink (Thread *thread);
+
+private:
+    Thread *_head;
+    Thread *_tail;
+    size_t _size;
+};
+
+/**
+ * a binary min-heap of the sleeping threads, keyed on the quantum they wake up in.
+ * every thread keeps its index in the heap, so it can also be removed in O(log n).
+ * the keys are kept in the heap next to the threads, so sifting reads the heap array only
+ * (and not a thread per level, which with many threads is a cache miss per level).
+ */
+class SleepHeap {
+
+public:
+    bool empty () const;
+    void push (Thread *thread);
+    Thread *top () const;
+    Thread *pop ();
+    void remove (Thread *thread);
+    void clear ();
+
+private:
+    struct Entry {
+        int wakeQuantum;
+        Thread *thread;
+    };
+
+    void place (size_t index, const Entry &entry);
+    void siftUp (size_t index);
+    void siftDown (size_t index);
+
+    std::vector<Entry> _heap;
+};
+
+#endif //THREADQUEUE_H
@@ -0,0 +1,128 @@
+#include "ThreadTable.h"
+#include <new>
+
+#define WORD_BITS 64
+
+/**
+ * constructor of an empty table (the first slab is allocated by the first create).
+ */
+ThreadTable::ThreadTable () : _searchFrom (0)
+{}
+
+/**
+ * the thread of id tid, nullptr if there is none.
+ */
+Thread *ThreadTable::get (int tid) const
+{
+    if (tid < 0 || tid >= end ())
+    {
+        return nullptr;
+    }
+    if (_free[tid / WORD_BITS] & ((uint64_t) 1 << (tid % WORD_BITS)))
+    {
+        return nullptr;
+    }
+    return _slabs[tid / THREAD_SLAB_SIZE] + tid % THREAD_SLAB_SIZE;
+}
+
+/**
+ * one past the largest id the table has room for: every thread has an id below it.
+ */
+int ThreadTable::end () const
+{
+    return (int) _slabs.size () * THREAD_SLAB_SIZE;
+}
+
+/**
+ * creates the main thread, which must be the first thread of the table (so it gets the id 0).
+ * On failure to allocate a slab returns nullptr.
+ */
+Thread *ThreadTable::createMain ()
+{
+    int tid = takeId ();
+    if (tid < 0)
+    {
+        return nullptr;
+    }
+    return new (_slabs[tid / THREAD_SLAB_SIZE] + tid % THREAD_SLAB_SIZE) Thread ();
+}
+
+/**
+ * creates a thread with the smallest free id. On failure to allocate a slab returns nullptr.
+ */
+Thread *ThreadTable::create (thread_entry_point entryPoint, char *stack)
+{
+    int tid = takeId ();
+    if (tid < 0)
+    {
+        return nullptr;
+    }
+    return new (_slabs[tid / THREAD_SLAB_SIZE] + tid % THREAD_SLAB_SIZE) Thread (tid, entryPoint, stack);
+}
+
+/**
+ * destroys a thread of the table, its id becomes free.
+ */
+void ThreadTable::destroy (Thread *thread)
+{
+    int tid = thread->getId ();
+    thread->~Thread ();
+    size_t word = (size_t) tid / WORD_BITS;
+    _free[word] |= (uint64_t) 1 << (tid % WORD_BITS);
+    _freeSummary[word / WORD_BITS] |= (uint64_t) 1 << (word % WORD_BITS);
+    if (word / WORD_BITS < _searchFrom)
+    {
+        _searchFrom = word / WORD_BITS;
+    }
+}
+
+/**
+ * marks the smallest free id taken and returns it, growing the table if it is full.
+ * On failure to allocate a slab returns -1.
+ */
+int ThreadTable::takeId ()
+{
+    while (_searchFrom < _freeSummary.size () && _freeSummary[_searchFrom] == 0)
+    {
+        _searchFrom++;
+    }
+    if (_searchFrom == _freeSummary.size () && !grow ())
+    {
+        return -1;
+    }
+    size_t word = _searchFrom * WORD_BITS + __builtin_ctzll (_freeSummary[_searchFrom]);
+    int bit = __builtin_ctzll (_free[word]);
+    _free[word] &= ~((uint64_t) 1 << bit);
+    if (_free[word] == 0)
+    {
+        _freeSummary[word / WORD_BITS] &= ~((uint64_t) 1 << (word % WORD_BITS));
+    }
+    return (int) (word * WORD_BITS) + bit;
+}
+
+/**
+ * adds a slab (of free ids) to the table. It is only called when every id is taken.
+ * @return true on success, false if the slab could not be allocated.
+ */
+bool ThreadTable::grow ()
+{
+    void *slab = ::operator new (sizeof (Thread) * THREAD_SLAB_SIZE, std::nothrow);
+    if (slab == nullptr)
+    {
+        return false;
+    }
+    _slabs.push_back (static_cast<Thread *> (slab));
+    // the new ids may share a summary word with the last (full) ones.
+    _searchFrom = _free.size () / WORD_BITS;
+    for (int i = 0; i < THREAD_SLAB_SIZE / WORD_BITS; ++i)
+    {
+        size_t word = _free.size ();
+        _free.push_back (~(uint64_t) 0);
+        if (word % WORD_BITS == 0)
+        {
+            _freeSummary.push_back (0);
+        }
+        _freeSummary[word / WORD_BITS] |= (uint64_t) 1 << (word % WORD_BITS);
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef THREADTABLE_H
+#define THREADTABLE_H
+#include <vector>
+#include <cstdint>
+#include "Thread.h"
+
+// the number of threads in a slab, a multiple of 64 (the ids of a slab fill whole bitmap words).
+#define THREAD_SLAB_SIZE 1024
+
+/**
+ * the threads of the library by id. It grows by slabs of THREAD_SLAB_SIZE threads, and the
+ * thread of id tid always lives in slot tid % THREAD_SLAB_SIZE of slab tid / THREAD_SLAB_SIZE,
+ * so looking a thread up is two array reads and spawning a thread allocates nothing but a
+ * new slab once in a while.
+ * which ids are free is kept apart from the threads, in a bitmap (a bit per id) with a summary
+ * bitmap over it (a bit per word of the bitmap that has a free id), so finding the smallest free
+ * id reads a few words instead of every thread.
+ * slabs are never freed: a thread that terminates itself still runs on its stack after it is
+ * destroyed, and the process is about to exit when the whole table is emptied.
+ */
+class ThreadTable {
+
+public:
+    ThreadTable ();
+    Thread *get (int tid) const;
+    int end () const;
+    Thread *createMain ();
+    Thread *create (thread_entry_point entryPoint, char *stack);
+    void destroy (Thread *thread);
+
+private:
+    int takeId ();
+    bool grow ();
+
+    std::vector<Thread *> _slabs;
+    // bit tid % 64 of word tid / 64 is set if the id tid is free.
+    std::vector<uint64_t> _free;
+    // bit w % 64 of word w / 64 is set if word w of _free has a free id.
+    std::vector<uint64_t> _freeSummary;
+    // no word of _freeSummary before this one has a free id.
+    size_t _searchFrom;
+};
+
+#endif //THREADTABLE_H
@@ -0,0 +1,203 @@
+#include "uthreads.h"
+#include "uthreads_mn.h"
+#include "uthreads_ext.h"
+#include "uthreads_io.h"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <atomic>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+/**
+ * Measures an echo server over loopback TCP, run by the threads of the library with a thread per
+ * connection.
+ * usage: io_bench [connections] [messages] [workers]
+ * connections server threads wait in uthread_accept on one listening socket, and connections
+ * client threads connect to it (uthread_connect) and send messages messages of MESSAGE_BYTES
+ * bytes each, one at a time, reading back the echo before sending the next (uthread_write /
+ * uthread_read). The main thread waits in uthread_read on a pipe the last client writes to.
+ * So all the threads but the running ones wait for I/O at any time, and the process would stall
+ * on the first of them with the blocking system calls. Prints the round trips per second.
+ * (the number of open files is raised to its hard limit: every connection takes two fds.)
+ */
+
+#define DEFAULT_CONNECTIONS 1000
+#define DEFAULT_MESSAGES 100
+#define MESSAGE_BYTES 64
+#define BENCH_QUANTUM_USECS 1000
+
+typedef std::chrono::steady_clock Clock;
+
+int listenFd = -1;
+struct sockaddr_in serverAddr;
+int messages = DEFAULT_MESSAGES;
+int connections = DEFAULT_CONNECTIONS;
+// the main thread waits on donePipe[0] until the last client writes to donePipe[1].
+int donePipe[2];
+std::atomic<int> clientsLeft (0);
+std::atomic<int> failures (0);
+
+/**
+ * reads exactly count bytes.
+ * @return false on failure or end of file.
+ */
+bool read_all (int fd, char *buf, size_t count)
+{
+    while (count > 0)
+    {
+        ssize_t done = uthread_read (fd, buf, count);
+        if (done <= 0)
+        {
+            return false;
+        }
+        buf += done;
+        count -= done;
+    }
+    return true;
+}
+
+/**
+ * writes exactly count bytes.
+ * @return false on failure.
+ */
+bool write_all (int fd, const char *buf, size_t count)
+{
+    while (count > 0)
+    {
+        ssize_t done = uthread_write (fd, buf, count);
+        if (done < 0)
+        {
+            return false;
+        }
+        buf += done;
+        count -= done;
+    }
+    return true;
+}
+
+/**
+ * accepts one connection and echoes it until the client closes it.
+ */
+void server ()
+{
+    int fd = uthread_accept (listenFd, nullptr, nullptr);
+    if (fd < 0)
+    {
+        failures++;
+        uthread_terminate (uthread_get_tid ());
+    }
+    char buf[MESSAGE_BYTES];
+    while (true)
+    {
+        ssize_t done = uthread_read (fd, buf, sizeof (buf));
+        if (done <= 0 || !write_all (fd, buf, done))
+        {
+            break;
+        }
+    }
+    close (fd);
+    uthread_terminate (uthread_get_tid ());
+}
+
+/**
+ * connects to the server and does the round trips. The last client to finish wakes up the main
+ * thread.
+ */
+void client ()
+{
+    int fd = socket (AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || uthread_connect (fd, (struct sockaddr *) &serverAddr, sizeof (serverAddr)))
+    {
+        failures++;
+    }
+    else
+    {
+        char out[MESSAGE_BYTES] = {};
+        char in[MESSAGE_BYTES];
+        for (int i = 0; i < messages; ++i)
+        {
+            out[0] = (char) i;
+            if (!write_all (fd, out, sizeof (out)) || !read_all (fd, in, sizeof (in)) || in[0] != out[0])
+            {
+                failures++;
+                break;
+            }
+        }
+    }
+    if (fd >= 0)
+    {
+        close (fd);
+    }
+    if (--clientsLeft == 0)
+    {
+        char done = 1;
+        uthread_write (donePipe[1], &done, 1);
+    }
+    uthread_terminate (uthread_get_tid ());
+}
+
+/**
+ * the listening socket on an ephemeral port of 127.0.0.1.
+ * @return false on failure.
+ */
+bool listen_loopback ()
+{
+    listenFd = socket (AF_INET, SOCK_STREAM, 0);
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = 0;
+    serverAddr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    socklen_t length = sizeof (serverAddr);
+    return listenFd >= 0 && bind (listenFd, (struct sockaddr *) &serverAddr, sizeof (serverAddr)) == 0
+           && listen (listenFd, connections) == 0
+           && getsockname (listenFd, (struct sockaddr *) &serverAddr, &length) == 0;
+}
+
+int main (int argc, char **argv)
+{
+    connections = argc > 1 ? atoi (argv[1]) : DEFAULT_CONNECTIONS;
+    messages = argc > 2 ? atoi (argv[2]) : DEFAULT_MESSAGES;
+    int workers = argc > 3 ? atoi (argv[3]) : 1;
+    if (connections < 1 || messages < 1 || workers < 1)
+    {
+        fprintf (stderr, "usage: io_bench [connections] [messages] [workers]\n");
+        return 1;
+    }
+    struct rlimit files;
+    getrlimit (RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    setrlimit (RLIMIT_NOFILE, &files);
+    if (!listen_loopback () || pipe (donePipe))
+    {
+        perror ("io_bench");
+        return 1;
+    }
+    if (2 * connections + 1 > MAX_THREAD_NUM && uthread_set_max_threads (2 * connections + 1))
+    {
+        return 1;
+    }
+    if (uthread_init_mn (BENCH_QUANTUM_USECS, workers))
+    {
+        return 1;
+    }
+    clientsLeft = connections;
+    Clock::time_point start = Clock::now ();
+    for (int i = 0; i < connections; ++i)
+    {
+        uthread_spawn (server);
+        uthread_spawn (client);
+    }
+    char done;
+    uthread_read (donePipe[0], &done, 1);
+    double ns = std::chrono::duration<double, std::nano> (Clock::now () - start).count ();
+    long roundTrips = (long) connections * messages;
+    printf ("connections,messages,workers,round_trips,failures,round_trips_per_sec,us_per_round_trip\n");
+    printf ("%d,%d,%d,%ld,%d,%.0f,%.2f\n", connections, messages, workers, roundTrips, failures.load (),
+            roundTrips / (ns / 1e9), ns / 1e3 / roundTrips);
+    fflush (stdout);
+    uthread_terminate (0);
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "uthreads.h"
+#include "uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/**
+ * Measures how the scheduling policies share the cpu and how fast they run a thread that wakes up.
+ * usage: sched_bench [share|quantum|latency|all] [threads] [quantum_usecs]
+ * - share: threads cpu bound threads (the main thread too), thread i of priority
+ *   i % NUM_PRIORITIES, run for SHARE_QUANTUMS quanta under every policy. Prints the share of
+ *   the work every thread did against the share the policy should give it (equal under round
+ *   robin, all to the highest priority under priority, by the weights under fair), and the Jain
+ *   fairness index of the ratios (1 when every thread got exactly its share).
+ * - quantum: the same threads under round robin, thread i with a quantum of (i + 1) quanta, so
+ *   the shares should follow the quantum lengths.
+ * - latency: threads cpu bound threads of DEFAULT_PRIORITY and one thread of priority 0 that
+ *   sleeps for one quantum LATENCY_SAMPLES times. Prints how long a sleep of one quantum took on
+ *   average and at the 99th percentile, in micro-seconds and in quanta.
+ * Every run is forked, since the library is initialized once per process. Only the main thread
+ * prints (the other threads have small stacks), so it is a cpu bound thread of the highest
+ * priority of the share scenarios.
+ * (the quantum timer counts cpu time, which the kernel checks on its clock ticks, so quanta of
+ * less than a few ticks are longer than asked.)
+ * CSV columns: scenario,policy,tid,priority,quantum_usecs,metric,value,expected
+ */
+
+#define DEFAULT_THREADS 8
+#define DEFAULT_QUANTUM_USECS 2000
+#define SHARE_QUANTUMS 600
+#define LATENCY_SAMPLES 200
+// the work loop checks whether the run is over once every that many iterations.
+#define CHECK_EVERY 4096
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * the weights of the priorities under POLICY_FAIR (as in RunQueue.cpp).
+ */
+static const double WEIGHTS[NUM_PRIORITIES] = {6100, 3906, 2501, 1586, 1024, 655, 423, 272};
+static const char *POLICY_NAMES[] = {"round_robin", "priority", "fair"};
+
+const char *scenario = "";
+SchedPolicy policy = POLICY_ROUND_ROBIN;
+int numThreads = DEFAULT_THREADS;
+int quantumUsecs = DEFAULT_QUANTUM_USECS;
+int priorities[MAX_THREAD_NUM];
+int quanta[MAX_THREAD_NUM];
+// the work done by every thread (indexed by tid), and where the result of the work goes.
+volatile unsigned long work[MAX_THREAD_NUM];
+volatile unsigned long sink;
+double samples[LATENCY_SAMPLES];
+volatile bool samplesDone = false;
+
+void print_row (int tid, int priority, int quantum, const char *metric, double value, double expected)
+{
+    printf ("%s,%s,%d,%d,%d,%s,%.4f,%.4f\n", scenario, POLICY_NAMES[policy], tid, priority, quantum,
+            metric, value, expected);
+}
+
+/**
+ * the share of the cpu every thread of the share scenarios should get.
+ */
+std::vector<double> expected_shares ()
+{
+    std::vector<double> expected (numThreads, 0);
+    double total = 0;
+    int best = NUM_PRIORITIES;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        best = std::min (best, priorities[i]);
+    }
+    for (int i = 0; i < numThreads; ++i)
+    {
+        if (strcmp (scenario, "quantum") == 0)
+        {
+            expected[i] = quanta[i];
+        }
+        else if (policy == POLICY_ROUND_ROBIN)
+        {
+            expected[i] = 1;
+        }
+        else if (policy == POLICY_PRIORITY)
+        {
+            expected[i] = priorities[i] == best ? 1 : 0;
+        }
+        else
+        {
+            expected[i] = WEIGHTS[priorities[i]];
+        }
+        total += expected[i];
+    }
+    for (double &share : expected)
+    {
+        share /= total;
+    }
+    return expected;
+}
+
+/**
+ * prints the shares and the fairness index.
+ */
+void report_shares ()
+{
+    double total = 0;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        total += work[i];
+    }
+    std::vector<double> expected = expected_shares ();
+    double sum = 0;
+    double squares = 0;
+    int counted = 0;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        double share = work[i] / total;
+        print_row (i, priorities[i], quanta[i] * quantumUsecs, "share", share, expected[i]);
+        if (expected[i] > 0)
+        {
+            double ratio = share / expected[i];
+            sum += ratio;
+            squares += ratio * ratio;
+            counted++;
+        }
+    }
+    print_row (-1, -1, quantumUsecs, "jain_index", sum * sum / (counted * squares), 1);
+}
+
+/**
+ * prints how long the sleeps of the latency thread took.
+ */
+void report_latency ()
+{
+    std::sort (samples, samples + LATENCY_SAMPLES);
+    double mean = 0;
+    for (double sample : samples)
+    {
+        mean += sample;
+    }
+    mean /= LATENCY_SAMPLES;
+    double p99 = samples[LATENCY_SAMPLES * 99 / 100];
+    // a sleep of one quantum takes one quantum at the least (the quantum of the next thread).
+    print_row (numThreads, 0, quantumUsecs, "mean_sleep_us", mean, quantumUsecs);
+    print_row (numThreads, 0, quantumUsecs, "p99_sleep_us", p99, quantumUsecs);
+    print_row (numThreads, 0, quantumUsecs, "mean_sleep_quanta", mean / quantumUsecs, 1);
+}
+
+/**
+ * the cpu bound work of a thread. The main thread also checks whether the run is over, and
+ * reports it.
+ */
+void cpu_thread ()
+{
+    int tid = uthread_get_tid ();
+    bool latency = strcmp (scenario, "latency") == 0;
+    unsigned long x = tid + 1;
+    while (true)
+    {
+        for (int i = 0; i < CHECK_EVERY; ++i)
+        {
+            x = x * 6364136223846793005ul + 1442695040888963407ul;
+        }
+        sink = x;
+        work[tid] += CHECK_EVERY;
+        if (tid == 0 && (latency ? samplesDone : uthread_get_total_quantums () >= SHARE_QUANTUMS))
+        {
+            if (latency)
+            {
+                report_latency ();
+            }
+            else
+            {
+                report_shares ();
+            }
+            fflush (stdout);
+            uthread_terminate (0);
+        }
+    }
+}
+
+/**
+ * sleeps for one quantum LATENCY_SAMPLES times, and blocks itself when it is done.
+ */
+void latency_thread ()
+{
+    for (int i = 0; i < LATENCY_SAMPLES; ++i)
+    {
+        Clock::time_point start = Clock::now ();
+        uthread_sleep (1);
+        samples[i] = std::chrono::duration<double, std::micro> (Clock::now () - start).count ();
+    }
+    samplesDone = true;
+    uthread_block (uthread_get_tid ());
+}
+
+/**
+ * one run, in a child process.
+ */
+void run ()
+{
+    if (uthread_init_policy (quantumUsecs, 1, policy) != 0)
+    {
+        exit (1);
+    }
+    // the threads get the tids 0..numThreads - 1 in order, and the latency thread the next one.
+    bool latency = strcmp (scenario, "latency") == 0;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        priorities[i] = latency ? DEFAULT_PRIORITY : i % NUM_PRIORITIES;
+        quanta[i] = strcmp (scenario, "quantum") == 0 ? i + 1 : 1;
+        if (i > 0)
+        {
+            uthread_spawn (cpu_thread);
+        }
+        uthread_set_priority (i, priorities[i]);
+        uthread_set_quantum (i, quanta[i] * quantumUsecs);
+    }
+    if (latency)
+    {
+        uthread_set_priority (uthread_spawn (latency_thread), 0);
+    }
+    cpu_thread ();
+}
+
+void fork_run (const char *runScenario, SchedPolicy runPolicy)
+{
+    fflush (stdout);
+    pid_t pid = fork ();
+    if (pid == 0)
+    {
+        scenario = runScenario;
+        policy = runPolicy;
+        run ();
+        exit (0);
+    }
+    int status;
+    waitpid (pid, &status, 0);
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    {
+        fprintf (stderr, "sched_bench: the %s run of %s failed\n", POLICY_NAMES[runPolicy], runScenario);
+    }
+}
+
+int main (int argc, char **argv)
+{
+    const char *which = argc > 1 ? argv[1] : "all";
+    numThreads = argc > 2 ? atoi (argv[2]) : DEFAULT_THREADS;
+    quantumUsecs = argc > 3 ? atoi (argv[3]) : DEFAULT_QUANTUM_USECS;
+    bool all = strcmp (which, "all") == 0;
+    if (numThreads < 1 || numThreads >= MAX_THREAD_NUM - 1 || quantumUsecs <= 0
+        || (!all && strcmp (which, "share") != 0 && strcmp (which, "quantum") != 0
+            && strcmp (which, "latency") != 0))
+    {
+        fprintf (stderr, "usage: sched_bench [share|quantum|latency|all] [threads] [quantum_usecs]\n");
+        return 1;
+    }
+    const SchedPolicy policies[] = {POLICY_ROUND_ROBIN, POLICY_PRIORITY, POLICY_FAIR};
+    printf ("scenario,policy,tid,priority,quantum_usecs,metric,value,expected\n");
+    if (all || strcmp (which, "share") == 0)
+    {
+        for (SchedPolicy runPolicy : policies)
+        {
+            fork_run ("share", runPolicy);
+        }
+    }
+    if (all || strcmp (which, "quantum") == 0)
+    {
+        fork_run ("quantum", POLICY_ROUND_ROBIN);
+    }
+    if (all || strcmp (which, "latency") == 0)
+    {
+        for (SchedPolicy runPolicy : policies)
+        {
+            fork_run ("latency", runPolicy);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "uthreads.h"
+#include "uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+/**
+ * Measures the throughput of spawning and terminating threads.
+ * usage: spawn_bench [rounds] [threads]
+ * Every round spawns threads threads (MAX_THREAD_NUM - 1 by default, a larger number raises the
+ * limit with uthread_set_max_threads) and then terminates them all from the main thread. The
+ * quantum is long enough that the spawned threads never run, so only the cost of spawn and
+ * terminate (mostly getting and releasing a stack and an id) is measured. The first round also
+ * maps the stacks and grows the thread table, so it is timed apart.
+ */
+
+#define DEFAULT_ROUNDS 20000
+#define BENCH_QUANTUM_USECS 10000000
+
+typedef std::chrono::steady_clock Clock;
+
+void idle ()
+{
+    while (true)
+    {}
+}
+
+/**
+ * spawns threads threads and terminates them.
+ * @return how long it took, in nano-seconds.
+ */
+double spawn_round (std::vector<int> &ids, int threads)
+{
+    Clock::time_point start = Clock::now ();
+    for (int i = 0; i < threads; ++i)
+    {
+        ids[i] = uthread_spawn (idle);
+    }
+    for (int i = 0; i < threads; ++i)
+    {
+        uthread_terminate (ids[i]);
+    }
+    return std::chrono::duration<double, std::nano> (Clock::now () - start).count ();
+}
+
+int main (int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi (argv[1]) : DEFAULT_ROUNDS;
+    int threads = argc > 2 ? atoi (argv[2]) : MAX_THREAD_NUM - 1;
+    if (rounds < 1 || threads < 1)
+    {
+        fprintf (stderr, "usage: spawn_bench [rounds] [threads]\n");
+        return 1;
+    }
+    if (threads >= MAX_THREAD_NUM && uthread_set_max_threads (threads + 1) != 0)
+    {
+        return 1;
+    }
+    if (uthread_init (BENCH_QUANTUM_USECS) != 0)
+    {
+        return 1;
+    }
+    std::vector<int> ids (threads);
+    double firstNs = spawn_round (ids, threads);
+    double ns = 0;
+    for (int r = 1; r < rounds; ++r)
+    {
+        ns += spawn_round (ids, threads);
+    }
+    long spawns = (long) threads * (rounds - 1);
+    printf ("threads,rounds,spawns,spawns_per_sec,ns_per_spawn_terminate,first_round_ns_per_spawn_terminate\n");
+    printf ("%d,%d,%ld,%.0f,%.1f,%.1f\n", threads, rounds, spawns, spawns > 0 ? spawns / (ns / 1e9) : 0,
+            spawns > 0 ? ns / spawns : 0, firstNs / threads);
+    uthread_terminate (0);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "uthreads.h"
+#include "uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <chrono>
+#include <ucontext.h>
+
+/**
+ * Measures the cost of a context switch.
+ * usage: switch_bench [rounds]
+ * The main thread and one spawned thread pass control to each other with uthread_yield, two
+ * switches per round. The quantum is long enough that the timer never fires, so only the
+ * cooperative switch is measured (a yield passes the rest of its quantum on, so it makes no
+ * system call at all). The reference is swapcontext with SIGVTALRM blocked and
+ * unblocked around every switch, which costs the same system calls as the sigsetjmp /
+ * siglongjmp switch the library used before.
+ */
+
+#define DEFAULT_ROUNDS 1000000
+#define BENCH_QUANTUM_USECS 10000000
+#define REF_STACK_SIZE (64 * 1024)
+
+typedef std::chrono::steady_clock Clock;
+
+int rounds = DEFAULT_ROUNDS;
+ucontext_t mainContext;
+ucontext_t refContext;
+sigset_t timerSet;
+
+void ping ()
+{
+    while (true)
+    {
+        uthread_yield ();
+    }
+}
+
+/**
+ * the same round trip, switching with swapcontext and the signal mask.
+ */
+void ref_swap (ucontext_t *from, ucontext_t *to)
+{
+    sigprocmask (SIG_BLOCK, &timerSet, nullptr);
+    swapcontext (from, to);
+    sigprocmask (SIG_UNBLOCK, &timerSet, nullptr);
+}
+
+void ref_ping ()
+{
+    while (true)
+    {
+        ref_swap (&refContext, &mainContext);
+    }
+}
+
+void print (const char *impl, long switches, double ns)
+{
+    printf ("%s,%ld,%.1f\n", impl, switches, ns / switches);
+}
+
+int main (int argc, char **argv)
+{
+    rounds = argc > 1 ? atoi (argv[1]) : DEFAULT_ROUNDS;
+    printf ("impl,switches,ns_per_switch\n");
+
+    sigemptyset (&timerSet);
+    sigaddset (&timerSet, SIGVTALRM);
+    static char refStack[REF_STACK_SIZE];
+    getcontext (&refContext);
+    refContext.uc_stack.ss_sp = refStack;
+    refContext.uc_stack.ss_size = sizeof (refStack);
+    refContext.uc_link = nullptr;
+    makecontext (&refContext, ref_ping, 0);
+    Clock::time_point start = Clock::now ();
+    for (int r = 0; r < rounds; ++r)
+    {
+        ref_swap (&mainContext, &refContext);
+    }
+    print ("swapcontext_sigprocmask", 2L * rounds,
+           std::chrono::duration<double, std::nano> (Clock::now () - start).count ());
+
+    if (uthread_init (BENCH_QUANTUM_USECS) != 0)
+    {
+        return 1;
+    }
+    uthread_spawn (ping);
+    start = Clock::now ();
+    for (int r = 0; r < rounds; ++r)
+    {
+        uthread_yield ();
+    }
+    print ("uthreads_yield", 2L * rounds,
+           std::chrono::duration<double, std::nano> (Clock::now () - start).count ());
+    fflush (stdout);
+    uthread_terminate (0);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "uthreads.h"
+#include "uthreads_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * Measures what the quantum ticks cost a thread that has the cpu to itself.
+ * usage: tick_bench [quantum_usecs] [sleepers]
+ * The main thread does a fixed amount of work while the other threads sleep for SLEEP_QUANTA
+ * quanta at a time, first without the library (the baseline), then with ticks and in tickless
+ * mode. Prints the time of the work, its overhead over the baseline, the system time of the
+ * process (the signals, timer calls and switches of the ticks) and the total number of quanta.
+ * The tickless mode counts the quanta it does not tick by their length, while ticks come late by
+ * up to a kernel clock tick, so it counts more of them.
+ * Every run is forked, since the library is initialized once per process.
+ */
+
+#define DEFAULT_QUANTUM_USECS 1000
+#define DEFAULT_SLEEPERS 8
+#define SLEEP_QUANTA 50
+#define WORK_ITERATIONS 2000000000ul
+
+typedef std::chrono::steady_clock Clock;
+
+volatile unsigned long sink;
+
+void sleeper ()
+{
+    while (true)
+    {
+        uthread_sleep (SLEEP_QUANTA);
+    }
+}
+
+/**
+ * the work of the main thread, in milliseconds.
+ */
+double work ()
+{
+    Clock::time_point start = Clock::now ();
+    unsigned long x = 1;
+    for (unsigned long i = 0; i < WORK_ITERATIONS; ++i)
+    {
+        x = x * 6364136223846793005ul + 1442695040888963407ul;
+    }
+    sink = x;
+    return std::chrono::duration<double, std::milli> (Clock::now () - start).count ();
+}
+
+/**
+ * the system time of the process, in milliseconds.
+ */
+double system_ms ()
+{
+    struct rusage usage;
+    getrusage (RUSAGE_SELF, &usage);
+    return usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+/**
+ * one run with the library, in a child process.
+ */
+void run (int tickless, int quantumUsecs, int sleepers, double baselineMs)
+{
+    fflush (stdout);
+    pid_t pid = fork ();
+    if (pid == 0)
+    {
+        uthread_set_tickless (tickless);
+        uthread_init (quantumUsecs);
+        for (int i = 0; i < sleepers; ++i)
+        {
+            uthread_spawn (sleeper);
+        }
+        double ms = work ();
+        printf ("%s,%d,%d,%.1f,%.2f,%.1f,%d\n", tickless ? "tickless" : "ticks", quantumUsecs, sleepers,
+                ms, (ms - baselineMs) / baselineMs * 100, system_ms (), uthread_get_total_quantums ());
+        fflush (stdout);
+        uthread_terminate (0);
+    }
+    int status;
+    waitpid (pid, &status, 0);
+}
+
+int main (int argc, char **argv)
+{
+    int quantumUsecs = argc > 1 ? atoi (argv[1]) : DEFAULT_QUANTUM_USECS;
+    int sleepers = argc > 2 ? atoi (argv[2]) : DEFAULT_SLEEPERS;
+    if (quantumUsecs <= 0 || sleepers < 0 || sleepers >= MAX_THREAD_NUM)
+    {
+        fprintf (stderr, "usage: tick_bench [quantum_usecs] [sleepers]\n");
+        return 1;
+    }
+    double baselineMs = work ();
+    printf ("mode,quantum_usecs,sleepers,work_ms,overhead_pct,system_ms,quanta\n");
+    printf ("baseline,%d,%d,%.1f,0.00,%.1f,0\n", quantumUsecs, sleepers, baselineMs, system_ms ());
+    run (0, quantumUsecs, sleepers, baselineMs);
+    run (1, quantumUsecs, sleepers, baselineMs);
+    return 0;
+}
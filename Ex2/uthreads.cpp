@@ -6,21 +6,36 @@
 
 /* Libraries */
 #include "uthreads.h"
+#include "uthreads_mn.h"
+#include "uthreads_ext.h"
+#include "uthreads_io.h"
 #include "Thread.h"
+#include "ThreadQueue.h"
+#include "ThreadTable.h"
+#include "StackPool.h"
+#include "RunQueue.h"
+#include "Reactor.h"
+#include "Context.h"
 #include <csignal>
-#include <iostream>
+#include <ctime>
+#include <cerrno>
+#include <atomic>
 #include <algorithm>
-#include <utmpx.h>
-#include <queue>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 /* CONSTANTS */
 #define FAILURE 1
 #define SUCCESS 0
 #define FAIL -1
-#define MSG_SETITIMER_FAIL "system error: system call - setitimer failed."
-#define MSG_PROCMASK_FAIL "system error: system call - sigprocmask failed"
+#define MSG_TIMER_FAIL "system error: system call - timer_create/timer_settime failed."
 #define MSG_NON_POSITIVE "system error: invalid - quantum_usecs is non-positive."
-#define MSG_SIGEMPTYSET_FAIL "system error: system call - sigemptyset failed"
 #define MSG_SIGACTION_FAIL "system error: system call - sigaction failed."
 #define MSG_NUM_EXCEED "system error: number of concurrent threads to exceed the limit."
 #define MSG_ENTRY_POINT_NULL "system error: entry_point is NULL."
@@ -30,164 +45,725 @@
 #define MSG_SLEEP_INVALID_TIME "system error: uthread_sleep - number of quantums is non positive."
 #define MSG_SLEEP_MAIN_THREAD "system error: the main thread trying to sleep."
 #define MSG_GET_QUANTUMS "system error: trying to get quantums of not exists thread."
-#define MSG_SIGADDSET_FAIL "system error: system call - sigaddset failed"
+#define MSG_STACK_FAIL "system error: system call - mmap of a thread stack failed."
+#define MSG_WORKERS_INVALID "system error: invalid - num_workers is not between 1 and MAX_WORKERS."
+#define MSG_PTHREAD_FAIL "system error: system call - pthread_create failed."
+#define MSG_FUTEX_FAIL "system error: system call - futex failed."
+#define MSG_POLICY_INVALID "system error: invalid - unknown scheduling policy."
+#define MSG_TICKLESS_AFTER_INIT "system error: the tickless mode must be set before the library is initialized."
+#define MSG_THREAD_ALLOC_FAIL "system error: allocation of the thread table failed."
+#define MSG_MAX_THREADS_INVALID "system error: invalid - max_threads is non-positive."
+#define MSG_MAX_THREADS_AFTER_INIT "system error: the thread limit must be set before the library is initialized."
+#define MSG_EPOLL_FAIL "system error: system call - epoll_wait failed."
+#define MSG_PRIORITY_INVALID "system error: invalid - priority is not between 0 and NUM_PRIORITIES - 1."
+
+// the scheduler of worker 0 runs on a stack of its own (the other workers use their pthread stack).
+#define SCHED_STACK_SIZE (64 * 1024)
+// a worker that waits for the scheduler lock yields its cpu after that many tries.
+#define SPINS_BEFORE_YIELD 100
+// the most I/O events a worker takes from the reactor at once.
+#define IO_EVENTS 64
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/**
+ * what a user thread that switches out asks its worker to do with it.
+ */
+enum SwitchAction {
+    NO_ACTION,
+    PREEMPT,
+    YIELD_SELF,
+    BLOCK_SELF,
+    SLEEP_SELF,
+    WAIT_IO_SELF,
+    TERMINATE_SELF
+};
+
+/**
+ * a kernel thread that runs user threads. A user thread always switches out to the scheduler loop
+ * of its worker (worker_loop), which runs on a stack of its own, and only there is the thread put
+ * back into a queue: so no other worker can resume a thread while its stack is still in use.
+ */
+struct Worker {
+    int id;
+    pthread_t pthread;
+    // fires after a quantum of cpu time of this worker (in tickless mode, maybe later or never).
+    timer_t timer;
+    // the quantum the timer ticks (0 while it is programmed for a thread that runs alone). A
+    // thread that yields to a thread with the same quantum leaves the timer as it is.
+    int timerQuantumUsecs;
+    // the ready threads of this worker, ordered by the policy. A worker with an empty queue steals
+    // from the others.
+    RunQueue *runQueue;
+    // the user thread running on this worker, nullptr while it schedules or idles.
+    Thread *current;
+    // the scheduler loop of the worker.
+    Context schedContext;
+    // the thread that switched out last, and what to do with it.
+    Thread *prev;
+    SwitchAction action;
+    // POLICY_FAIR: when the running thread was last charged for its running time (CLOCK_MONOTONIC).
+    uint64_t sliceStart;
+    // tickless mode: the running thread is the only thread of the worker, and its quanta are not
+    // ticked. They are counted from the cpu time of the worker, from aloneStart on (see
+    // catch_up). The timer fires only at the end of quantum number aloneQuanta, when the next
+    // sleeper wakes up (or never if aloneQuanta is 0).
+    bool alone;
+    uint64_t aloneStart;
+    uint64_t aloneQuantumNs;
+    int aloneQuanta;
+};
 
 /* internal interface (functions declaration) */
-void block_signals();
-void unblock_signals();
-void jump_to_thread (int tid);
-void switch_thread ();
-void timer_handler (int sig);
-void init_Timer(int quantum_usecs);
+void enter_critical();
+void leave_critical();
+void sched_lock();
+void sched_unlock();
+Worker *current_worker();
+void switch_out (SwitchAction action);
+void worker_loop ();
+void timer_handler (int sig, siginfo_t *info, void *context);
+void init_Timer(struct itimerspec *spec, int quantum_usecs);
+void arm_timer(Worker *worker, uint64_t valueNs, int quantum_usecs);
 
 /* global variables (including data structures) */
-struct itimerval timer;
-sigset_t set;
 int user_quantum_usecs = 0;
-int currentThread = 0;
+SchedPolicy schedPolicy = POLICY_ROUND_ROBIN;
+bool ticklessMode = false;
 int concurrentThreads = 1;
+// the most threads that may exist at once (MAX_THREAD_NUM unless uthread_set_max_threads raised it).
+int maxThreads = MAX_THREAD_NUM;
 int totalNumQuantums = 1;
-Thread *ThreadList[MAX_THREAD_NUM];
-std::deque<int> readyList;
-std::vector<int> blockedList;
-std::vector<int> sleepList;
+ThreadTable threadTable;
+ThreadQueue blockedList;
+SleepHeap sleepHeap;
+Reactor reactor;
+// the threads whose I/O the reactor found ready, while the worker that polled makes them ready.
+std::vector<Thread *> ioWoken;
+StackPool stackPool;
+Worker *workers = nullptr;
+int numWorkers = 0;
+// the number of workers waiting for a ready thread.
+int idleWorkers = 0;
+// one of them waits in the reactor (for I/O or for a ready thread), the others on workSeq.
+bool ioPolling = false;
+// protects all the scheduler state above. It is only held inside a critical section, so the
+// timer handler never waits for a lock held by the thread it interrupted.
+std::atomic_flag schedulerLock = ATOMIC_FLAG_INIT;
+// idle workers sleep on this futex word, and it changes whenever a thread becomes ready.
+std::atomic<int> workSeq (0);
+// the worker of the calling kernel thread, see current_worker().
+thread_local Worker *tlsWorker = nullptr;
+// set while the kernel thread runs library code (see enter_critical), and the preemption that
+// the timer handler put off until it leaves. initial-exec, so every access is a single
+// instruction relative to %fs (and see try_leave_critical).
+thread_local volatile sig_atomic_t tlsCritical __attribute__((tls_model("initial-exec"))) = 0;
+thread_local volatile sig_atomic_t tlsPreemptPending __attribute__((tls_model("initial-exec"))) = 0;
+
+/**
+ * deletes a thread and gives its stack back to the stack pool.
+ **/
+void delete_thread(Thread *thread) {
+    reactor.remove (thread);
+    if (thread->getStack () != nullptr)
+    {
+        stackPool.release (thread->getStack ());
+    }
+    threadTable.destroy (thread);
+}
+
+/**
+ * true if the thread runs on a worker other than the calling one.
+ **/
+bool runs_elsewhere(Thread *thread) {
+    for (int w = 0; w < numWorkers; ++w)
+    {
+        if (workers[w].current == thread && tlsWorker != workers + w)
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
 /**
  * this function deallocates all the memory that was allocated in the Heap.
+ * (threads running on other workers are left alone, the process is about to exit.)
  **/
 void free_all() {
-    for (int i = MAX_THREAD_NUM - 1; i >= 0; --i)
+    blockedList.clear();
+    sleepHeap.clear();
+    for (int w = 0; w < numWorkers; ++w)
     {
-        if (ThreadList[i] != nullptr)
+        if (workers[w].runQueue != nullptr)
         {
-            delete ThreadList[i];
-            ThreadList[i] = nullptr;
+            workers[w].runQueue->clear();
+        }
+    }
+    for (int i = threadTable.end () - 1; i >= 0; --i)
+    {
+        Thread *thread = threadTable.get (i);
+        if (thread != nullptr && !runs_elsewhere (thread))
+        {
+            delete_thread (thread);
         }
     }
-    readyList.clear();
-    blockedList.clear();
-    sleepList.clear();
     concurrentThreads = 0;
 }
 
 /**
- * blocking SIGVTALRM signal.
+ * starts a critical section: until leave_critical, the timer handler does not switch the thread
+ * out, and only records that it should. Replaces blocking SIGVTALRM, without a system call.
+ **/
+__attribute__((noinline)) void enter_critical() {
+    tlsCritical = 1;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+}
+
+/**
+ * clears the critical flag, unless the timer handler put off a preemption meanwhile.
+ * noinline, like every function that touches the flags: the address of a thread_local must not be
+ * kept across a switch, after which the thread may run on another kernel thread.
+ * @return true if the caller must switch out (still in a critical section).
  **/
-void block_signals() {
-    if (sigprocmask(SIG_BLOCK, &set, nullptr))
+__attribute__((noinline)) bool try_leave_critical() {
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    tlsCritical = 0;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    if (!tlsPreemptPending)
     {
-        std::cerr << MSG_PROCMASK_FAIL << std::endl;
-        free_all();
-        exit (FAILURE);
+        return false;
     }
+    tlsCritical = 1;
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    tlsPreemptPending = 0;
+    return true;
+}
+
+/**
+ * ends a critical section, and does the preemption the timer handler put off meanwhile.
+ **/
+void leave_critical() {
+    while (try_leave_critical())
+    {
+        switch_out (PREEMPT);
+    }
+}
+
+/**
+ * locks the scheduler state (in a critical section).
+ **/
+void sched_lock() {
+    int spins = 0;
+    while (schedulerLock.test_and_set (std::memory_order_acquire))
+    {
+        if (++spins == SPINS_BEFORE_YIELD)
+        {
+            spins = 0;
+            sched_yield ();
+        }
+    }
+}
+
+/**
+ * unlocks the scheduler state.
+ **/
+void sched_unlock() {
+    schedulerLock.clear (std::memory_order_release);
+}
+
+/**
+ * the worker of the calling kernel thread. A user thread may continue on another worker after it
+ * switches out, so the worker is read again after every switch: this function is never inlined
+ * and its result is not cached by the compiler.
+ **/
+__attribute__((noinline)) Worker *current_worker() {
+    asm volatile ("" ::: "memory");
+    return tlsWorker;
 }
 
 /**
- * unblocking SIGVTALRM signal.
+ * wakes up an idle worker (if any) after a thread became ready.
+ * must be called with the scheduler locked.
  **/
-void unblock_signals() {
-    if (sigprocmask(SIG_UNBLOCK, &set, nullptr))
+void notify_work() {
+    if (ioPolling)
     {
-        std::cerr << MSG_PROCMASK_FAIL << std::endl;
+        reactor.wake ();
+    }
+    if (idleWorkers > 0)
+    {
+        workSeq.fetch_add (1);
+        if (syscall (SYS_futex, reinterpret_cast<int *> (&workSeq), FUTEX_WAKE_PRIVATE, 1,
+                     nullptr, nullptr, 0) < 0)
+        {
+            std::cerr << MSG_FUTEX_FAIL << std::endl;
+            free_all();
+            exit (FAILURE);
+        }
+    }
+}
+
+/**
+ * nanoseconds of CLOCK_MONOTONIC (no system call, it is read through the vdso).
+ **/
+uint64_t now_ns() {
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * nanoseconds of cpu time of the calling kernel thread, the clock of the timer of its worker.
+ **/
+uint64_t cpu_now_ns() {
+    struct timespec now;
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * tickless mode: counts the quanta the thread running alone on a worker has started since they
+ * were last counted, as if they had been ticked. The quantum the timer fires at is left to the
+ * switch it causes. must be called on the kernel thread of the worker, with the scheduler locked.
+ **/
+void catch_up(Worker *worker) {
+    if (!worker->alone)
+    {
+        return;
+    }
+    int started = (int) ((cpu_now_ns () - worker->aloneStart) / worker->aloneQuantumNs);
+    if (worker->aloneQuanta > 0 && started >= worker->aloneQuanta)
+    {
+        started = worker->aloneQuanta - 1;
+    }
+    totalNumQuantums += started;
+    worker->current->addQuantums (started);
+    worker->aloneStart += started * worker->aloneQuantumNs;
+    if (worker->aloneQuanta > 0)
+    {
+        worker->aloneQuanta -= started;
+    }
+}
+
+/**
+ * POLICY_FAIR: charges the thread running on a worker for the time since it was last charged.
+ * must be called with the scheduler locked.
+ **/
+void charge_current(Worker *worker) {
+    if (schedPolicy == POLICY_FAIR && worker->current != nullptr)
+    {
+        uint64_t now = now_ns ();
+        worker->runQueue->charge (worker->current, now - worker->sliceStart);
+        worker->sliceStart = now;
+    }
+}
+
+/**
+ * moves a thread to the run queue of a worker.
+ * must be called with the scheduler locked.
+ * @return true if the thread should preempt the thread running on the worker right away.
+ **/
+bool make_ready(Thread *thread, Worker *worker) {
+    thread->setState (READY);
+    worker->runQueue->push (thread);
+    notify_work ();
+    if (worker->current == nullptr)
+    {
+        return false;
+    }
+    if (worker->alone)
+    {
+        // the running thread is not alone anymore: its quanta are ticked again, from the end of
+        // the quantum it is in.
+        catch_up (worker);
+        worker->alone = false;
+        uint64_t used = cpu_now_ns () - worker->aloneStart;
+        uint64_t left = used < worker->aloneQuantumNs ? worker->aloneQuantumNs - used : 1;
+        arm_timer (worker, left, (int) (worker->aloneQuantumNs / 1000));
+    }
+    charge_current (worker);
+    return worker->runQueue->preempts (thread, worker->current);
+}
+
+/**
+ * interrupts the worker that runs the thread, so it switches the thread out and carries out the
+ * request of the thread. must be called with the scheduler locked.
+ **/
+void kick_worker(Thread *thread) {
+    for (int w = 0; w < numWorkers; ++w)
+    {
+        if (workers[w].current == thread)
+        {
+            pthread_kill (workers[w].pthread, SIGVTALRM);
+        }
+    }
+}
+
+/**
+ * true if tid is a thread that exists (and was not asked to terminate).
+ * must be called with the scheduler locked.
+ **/
+bool valid_tid(int tid) {
+    Thread *thread = threadTable.get (tid);
+    return thread != nullptr && thread->getRequest () != TERMINATE_REQUEST;
+}
+
+/**
+ * the length of the quanta of a thread.
+ **/
+int quantum_of(Thread *thread) {
+    return thread->getQuantumUsecs () > 0 ? thread->getQuantumUsecs () : user_quantum_usecs;
+}
+
+/**
+ * arms the timer of a worker: it fires after valueNs of cpu time (never if 0), and then every
+ * quantum_usecs.
+ **/
+void arm_timer(Worker *worker, uint64_t valueNs, int quantum_usecs) {
+    struct itimerspec spec;
+    init_Timer (&spec, quantum_usecs);
+    spec.it_value.tv_sec = (time_t) (valueNs / 1000000000);
+    spec.it_value.tv_nsec = (long) (valueNs % 1000000000);
+    if (timer_settime (worker->timer, 0, &spec, nullptr))
+    {
+        std::cerr << MSG_TIMER_FAIL << std::endl;
         free_all();
         exit (FAILURE);
     }
 }
 
 /**
- * totalNumQuantums++ and sleepList check.
- * set of the timer.
+ * starts the quantum timer of a worker, for the quantum of the thread it switches to.
+ **/
+void start_timer(Worker *worker, Thread *thread) {
+    uint64_t quantumNs = (uint64_t) quantum_of (thread) * 1000;
+    // a thread that runs alone gets no tick until the next sleeper wakes up.
+    arm_timer (worker, worker->alone ? worker->aloneQuanta * quantumNs : quantumNs, quantum_of (thread));
+    worker->timerQuantumUsecs = worker->alone ? 0 : quantum_of (thread);
+}
+
+/**
+ * tickless mode: when the worker runs a thread that has no other thread to share the worker with,
+ * stops ticking its quanta (they are counted by catch_up), and programs the timer for the quantum
+ * the next sleeper wakes up in. must be called with the scheduler locked.
  **/
-void timer_sleep_check() {
-    block_signals();
+void decide_tickless(Worker *worker, Thread *next) {
+    // the reactor is polled when the worker switches, so it keeps switching while threads wait for I/O.
+    worker->alone = ticklessMode && worker->runQueue->empty () && !reactor.waiting ();
+    if (worker->alone)
+    {
+        worker->aloneStart = cpu_now_ns ();
+        worker->aloneQuantumNs = (uint64_t) quantum_of (next) * 1000;
+        worker->aloneQuanta = 0;
+        if (!sleepHeap.empty ())
+        {
+            // (a sleeper that is already due wakes up at the next switch of some worker.)
+            worker->aloneQuanta = std::max (1, sleepHeap.top ()->getWakeQuantum () - totalNumQuantums);
+        }
+    }
+}
+
+/**
+ * tickless mode: a thread went to sleep, and it wakes up first. The workers that run alone may
+ * not tick before it wakes up, so they are interrupted to program their timers for it.
+ * must be called with the scheduler locked.
+ **/
+void kick_alone_workers(Worker *worker) {
+    for (int w = 0; w < numWorkers; ++w)
+    {
+        if (workers + w != worker && workers[w].alone)
+        {
+            pthread_kill (workers[w].pthread, SIGVTALRM);
+        }
+    }
+}
+
+/**
+ * totalNumQuantums++ and wakes up the threads whose sleep ends in the new quantum (into the run
+ * queue of the worker). must be called with the scheduler locked.
+ **/
+void timer_sleep_check(Worker *worker) {
     totalNumQuantums++;
-    for (unsigned long int i = 0; i < sleepList.size (); i++)
+    // the sleep heap is ordered by wake up quantum, so only the threads that wake up are visited.
+    while (!sleepHeap.empty () && sleepHeap.top ()->getWakeQuantum () <= totalNumQuantums)
     {
-        ThreadList[sleepList[i]]->decSleepTime ();
-        if (ThreadList[sleepList[i]]->getSleepTime () == 0)
+        Thread *thread = sleepHeap.pop ();
+        // if thread's state is BLOCKED, we do nothing (thread stays in blockedList until resume()).
+        if (thread->getState () == SLEEP_NOT_BLOCKED)
         {
-            sleepList.erase (sleepList.begin () + i);
-            // if thread's state is BLOCKED, we do nothing (thread stays in blockedList until resume()).
-            if (ThreadList[sleepList[i]]->getState () == SLEEP_NOT_BLOCKED)
-            {
-                ThreadList[sleepList[i]]->setState (READY);
-                readyList.push_back (sleepList[i]);
-            }
+            make_ready (thread, worker);
         }
     }
-    if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
+}
+
+/**
+ * takes the events of the reactor, and moves the threads whose I/O is ready to the run queue of
+ * the worker. With block, the worker sleeps until there is an event (or notify_work wakes it up),
+ * with the scheduler unlocked meanwhile. must be called with the scheduler locked.
+ **/
+void poll_io(Worker *worker, bool block) {
+    struct epoll_event events[IO_EVENTS];
+    if (block)
+    {
+        ioPolling = true;
+        sched_unlock ();
+    }
+    int count = reactor.poll (events, IO_EVENTS, block ? -1 : 0);
+    if (block)
     {
-        std::cerr << MSG_SETITIMER_FAIL << std::endl;
+        sched_lock ();
+        ioPolling = false;
+    }
+    if (count < 0)
+    {
+        std::cerr << MSG_EPOLL_FAIL << std::endl;
         free_all();
-        unblock_signals();
         exit (FAILURE);
     }
-    unblock_signals();
+    reactor.dispatch (events, count, ioWoken);
+    for (Thread *thread : ioWoken)
+    {
+        // a BLOCKED thread stays in blockedList until resume(), and a thread that did not switch
+        // out yet is made ready when it does.
+        if (thread->getState () == IO_WAIT_NOT_BLOCKED)
+        {
+            make_ready (thread, worker);
+        }
+    }
+    ioWoken.clear ();
+}
+
+/**
+ * saves the running thread and switches to the scheduler loop of its worker, which does the
+ * action. must be called in a critical section, with the scheduler unlocked. Returns when the
+ * thread is resumed (maybe on another worker), still in a critical section.
+ **/
+void switch_out (SwitchAction action)
+{
+    Worker *worker = current_worker();
+    Thread *thread = worker->current;
+    worker->prev = thread;
+    worker->action = action;
+    swap_context (&thread->_context, &worker->schedContext);
+}
+
+/**
+ * runs on the scheduler stack, after the previous thread of the worker switched out: puts it where
+ * its action (or a request of another thread) says. must be called with the scheduler locked.
+ **/
+void finish_switch(Worker *worker)
+{
+    catch_up (worker);
+    worker->alone = false;
+    charge_current (worker);
+    Thread *thread = worker->prev;
+    worker->prev = nullptr;
+    worker->current = nullptr;
+    if (thread == nullptr)
+    {
+        return;
+    }
+    if (worker->action == TERMINATE_SELF || thread->getRequest () == TERMINATE_REQUEST)
+    {
+        // the thread does not run on its stack anymore, so the stack can be reused right away.
+        delete_thread (thread);
+        concurrentThreads--;
+        return;
+    }
+    if (worker->action == SLEEP_SELF)
+    {
+        sleepHeap.push (thread);
+        if (ticklessMode && sleepHeap.top () == thread)
+        {
+            kick_alone_workers (worker);
+        }
+    }
+    if (worker->action == BLOCK_SELF || thread->getRequest () == BLOCK_REQUEST)
+    {
+        thread->setState (BLOCKED);
+        blockedList.pushBack (thread);
+    }
+    else if (worker->action == SLEEP_SELF)
+    {
+        thread->setState (SLEEP_NOT_BLOCKED);
+    }
+    else if (worker->action == WAIT_IO_SELF && thread->isWaitingIo ())
+    {
+        // (if the reactor already ended the wait, the thread is made ready below.)
+        thread->setState (IO_WAIT_NOT_BLOCKED);
+    }
+    else
+    {
+        make_ready (thread, worker);
+    }
+    thread->setRequest (NO_REQUEST);
 }
 
 /**
- * jumping to next thread with siglongjmp.
+ * the next thread for a worker: the first of its own run queue, or else the first of the queue of
+ * another worker. must be called with the scheduler locked.
  **/
-void jump_to_thread (int tid)
+Thread *pick_next(Worker *worker)
 {
-    block_signals();
-    // signal still blocked (from switch_thread)
-    currentThread = tid;
-    ThreadList[tid]->setState (RUNNING);
-    ThreadList[tid]->incQuantums ();
-    timer_sleep_check();
-    unblock_signals(); // important to jump to next threat without blocking signals!
-    siglongjmp(ThreadList[tid]->_env, 1); // no return value
+    Thread *next = worker->runQueue->pop ();
+    for (int i = 1; next == nullptr && i < numWorkers; ++i)
+    {
+        RunQueue *other = workers[(worker->id + i) % numWorkers].runQueue;
+        next = other->pop ();
+        if (next != nullptr)
+        {
+            worker->runQueue->adopt (next, other);
+        }
+    }
+    return next;
 }
 
 /**
- * switch between two Threads.
+ * the scheduler loop of a worker, on a stack of its own and always in a critical section. Every
+ * user thread switches out to here: the previous thread is put away, the next thread is picked
+ * (or the worker sleeps until there is one), and the worker switches into it.
  **/
-void switch_thread ()
+void worker_loop ()
 {
-    // we can't put switch_thread() inside timer_handler()
-    // because sometimes we do not want the thread to get inside readyList.
-    block_signals();
-    // sigsetjmp can not fail
-    int ret_val = sigsetjmp(ThreadList[currentThread]->_env, 1);
-    bool did_just_save_bookmark = ret_val == 0;
-    if (did_just_save_bookmark)
-        // enters only first time (it saves env with sigset).
-        // Doesn't enter if we continue the thread from the saved point.
+    Worker *worker = current_worker();
+    while (true)
     {
-        int firstElem = readyList.front ();
-        readyList.pop_front ();
-        jump_to_thread (firstElem);
+        sched_lock ();
+        // a yield that is not followed by a tickless quantum passes the rest of its quantum on.
+        bool yielded = worker->prev != nullptr && worker->action == YIELD_SELF && worker->timerQuantumUsecs != 0;
+        finish_switch (worker);
+        // a new quantum starts: the threads that wake up in it (or whose I/O is ready) compete
+        // for it too.
+        timer_sleep_check (worker);
+        if (reactor.waiting ())
+        {
+            poll_io (worker, false);
+        }
+        Thread *next = pick_next (worker);
+        while (next == nullptr)
+        {
+            idleWorkers++;
+            if (reactor.waiting () && !ioPolling)
+            {
+                // the worker waits for I/O for all the workers.
+                poll_io (worker, true);
+                idleWorkers--;
+                next = pick_next (worker);
+                continue;
+            }
+            int seq = workSeq.load ();
+            sched_unlock ();
+            if (syscall (SYS_futex, reinterpret_cast<int *> (&workSeq), FUTEX_WAIT_PRIVATE, seq,
+                         nullptr, nullptr, 0) && errno != EAGAIN && errno != EINTR)
+            {
+                std::cerr << MSG_FUTEX_FAIL << std::endl;
+                exit (FAILURE);
+            }
+            sched_lock ();
+            idleWorkers--;
+            next = pick_next (worker);
+        }
+        worker->current = next;
+        next->setState (RUNNING);
+        next->incQuantums ();
+        if (schedPolicy == POLICY_FAIR)
+        {
+            worker->sliceStart = now_ns ();
+        }
+        decide_tickless (worker, next);
+        // a preemption that was put off belongs to the quantum that just ended. (a worker that
+        // interrupts this one from now on holds the lock after this point, so it is not lost.)
+        tlsPreemptPending = 0;
+        sched_unlock ();
+        if (!yielded || worker->alone || quantum_of (next) != worker->timerQuantumUsecs)
+        {
+            start_timer (worker, next);
+        }
+        swap_context (&worker->schedContext, &next->_context);
     }
-    unblock_signals();
 }
 
 /**
- * override of the default signal handler (each time the signal occurs, it switches two threads).
+ * the first code of every spawned thread: leaves the critical section of the switch into it and
+ * calls its entry point. An entry point that returns terminates its thread.
  **/
-void timer_handler (int sig)
+void thread_start ()
 {
-    block_signals();
-    // we first put the currentThread inside readyList and only after that, we take the first thread from there
-    // It's in case only main thread is running. So readyList won't be empty when we do pop_front().
-    ThreadList[currentThread]->setState (READY);
-    readyList.push_back (currentThread);
-    switch_thread ();
-    unblock_signals();
+    thread_entry_point entryPoint = current_worker()->current->getEntryPoint ();
+    leave_critical();
+    entryPoint ();
+    uthread_terminate (uthread_get_tid ());
 }
 
 /**
- * Defines the timer cycle (the signal SIGVTALRM is called by the OS each quantum time).
+ * override of the default signal handler. The timer of a worker signals it every quantum, and
+ * other workers signal it when they ask something of the thread it runs: either way the thread
+ * switches out, right away or when it leaves the library.
+ * (installed with SA_NODEFER: the handler may switch to another thread, which must not start
+ * with SIGVTALRM blocked.)
  **/
-void init_Timer(int quantum_usecs)
+void timer_handler (int sig, siginfo_t *info, void *context)
+{
+    if (tlsCritical)
+    {
+        tlsPreemptPending = 1;
+        return;
+    }
+    int savedErrno = errno;
+    enter_critical();
+    Worker *worker = current_worker();
+    if (worker != nullptr && worker->current != nullptr)
+    {
+        switch_out (PREEMPT);
+    }
+    leave_critical();
+    errno = savedErrno;
+}
+
+/**
+ * Defines the timer cycle (the signal SIGVTALRM is sent to a worker each quantum of its cpu time).
+ **/
+void init_Timer(struct itimerspec *spec, int quantum_usecs)
 {
     // Configure the timer to expire after quantum microseconds... */
-    timer.it_value.tv_sec = quantum_usecs / (int)(1e6);        // first time interval, seconds part
-    timer.it_value.tv_usec = quantum_usecs % (int)(1e6);    // first time interval, microseconds part
+    spec->it_value.tv_sec = quantum_usecs / (int)(1e6);        // first time interval, seconds part
+    spec->it_value.tv_nsec = quantum_usecs % (int)(1e6) * 1000;    // first time interval, nanoseconds part
 
     // configure the timer to expire every quantum microseconds after that.
-    timer.it_interval.tv_sec = quantum_usecs / (int)(1e6);      // following time intervals, seconds part
-    timer.it_interval.tv_usec = quantum_usecs % (int)(1e6);   // following time intervals, microseconds part
+    spec->it_interval.tv_sec = quantum_usecs / (int)(1e6);      // following time intervals, seconds part
+    spec->it_interval.tv_nsec = quantum_usecs % (int)(1e6) * 1000;   // following time intervals, nanoseconds part
+}
+
+/**
+ * creates the timer of a worker, on the cpu clock of the calling kernel thread (the worker itself).
+ **/
+void init_worker_timer(Worker *worker)
+{
+    struct sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGVTALRM;
+    event.sigev_notify_thread_id = (pid_t) syscall (SYS_gettid);
+    if (timer_create (CLOCK_THREAD_CPUTIME_ID, &event, &worker->timer))
+    {
+        std::cerr << MSG_TIMER_FAIL << std::endl;
+        free_all();
+        exit (FAILURE);
+    }
+}
+
+/**
+ * the kernel thread of workers 1..n-1: runs the scheduler loop on the pthread stack.
+ **/
+void *worker_main(void *arg)
+{
+    enter_critical();
+    tlsWorker = (Worker *) arg;
+    init_worker_timer (tlsWorker);
+    worker_loop ();
+    return nullptr;
 }
 
 /**
@@ -202,29 +778,47 @@ void init_Timer(int quantum_usecs)
  * @return On success, return 0. On failure, return -1.
 */
 int uthread_init (int quantum_usecs)
+{
+    return uthread_init_mn (quantum_usecs, 1);
+}
+
+/**
+ * @brief initializes the thread library with num_workers kernel threads, see uthreads_mn.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_mn (int quantum_usecs, int num_workers)
+{
+    return uthread_init_policy (quantum_usecs, num_workers, POLICY_ROUND_ROBIN);
+}
+
+/**
+ * @brief initializes the thread library with a scheduling policy, see uthreads_ext.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_policy (int quantum_usecs, int num_workers, SchedPolicy policy)
 {
     if (quantum_usecs <= 0)
     {
         std::cerr << MSG_NON_POSITIVE << std::endl;
         return FAIL;
     }
-    if (sigemptyset(&set))
+    if (num_workers < 1 || num_workers > MAX_WORKERS)
     {
-        std::cerr << MSG_SIGEMPTYSET_FAIL << std::endl;
-        free_all();
-        exit (FAILURE);
+        std::cerr << MSG_WORKERS_INVALID << std::endl;
+        return FAIL;
     }
-    if (sigaddset(&set, SIGVTALRM))
+    if (policy != POLICY_ROUND_ROBIN && policy != POLICY_PRIORITY && policy != POLICY_FAIR)
     {
-        std::cerr << MSG_SIGADDSET_FAIL << std::endl;
-        free_all();
-        exit (FAILURE);
+        std::cerr << MSG_POLICY_INVALID << std::endl;
+        return FAIL;
     }
-
-    struct sigaction sa = {0};
-    sa.sa_handler = &timer_handler;
+    struct sigaction sa = {};
+    sa.sa_sigaction = &timer_handler;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
     user_quantum_usecs = quantum_usecs;
-    init_Timer(user_quantum_usecs);
+    schedPolicy = policy;
 
     if (sigaction (SIGVTALRM, &sa, nullptr) < 0)
     {
@@ -233,20 +827,66 @@ int uthread_init (int quantum_usecs)
         exit (FAILURE);
     }
 
-    // we make sure signals are blocked before we start the timer (setitimer).
-    block_signals();
-    Thread* mainThread = new Thread();
-    ThreadList[0] = mainThread;
-    currentThread = 0;
+    // the timer handler saves errno on the stack of the thread it interrupts. The first use of
+    // errno binds it lazily, which needs more stack than a thread has, so it is bound here.
+    errno = 0;
 
-    // starts timer
-    if (setitimer (ITIMER_VIRTUAL, &timer, nullptr))
+    // we make sure we are in a critical section before we start the timer.
+    enter_critical();
+    workers = new Worker[num_workers];
+    numWorkers = num_workers;
+    for (int w = 0; w < num_workers; ++w)
     {
-        std::cerr << MSG_SETITIMER_FAIL << std::endl;
+        workers[w].id = w;
+        workers[w].current = nullptr;
+        workers[w].prev = nullptr;
+        workers[w].action = NO_ACTION;
+        workers[w].runQueue = RunQueue::create (policy, quantum_usecs);
+        workers[w].sliceStart = now_ns ();
+        workers[w].alone = false;
+        workers[w].timerQuantumUsecs = 0;
+    }
+
+    // the calling kernel thread is worker 0, and its stack stays with the main thread, so the
+    // scheduler of worker 0 gets a stack of its own.
+    Worker *worker = workers;
+    tlsWorker = worker;
+    worker->pthread = pthread_self ();
+    init_worker_timer (worker);
+    char *schedStack = map_stack (SCHED_STACK_SIZE);
+    if (schedStack == nullptr)
+    {
+        std::cerr << MSG_STACK_FAIL << std::endl;
         free_all();
         exit (FAILURE);
     }
-    unblock_signals();
+    init_context (&worker->schedContext, schedStack, SCHED_STACK_SIZE, worker_loop);
+
+    Thread* mainThread = threadTable.createMain ();
+    if (mainThread == nullptr)
+    {
+        std::cerr << MSG_THREAD_ALLOC_FAIL << std::endl;
+        free_all();
+        exit (FAILURE);
+    }
+    worker->current = mainThread;
+
+    for (int w = 1; w < num_workers; ++w)
+    {
+        if (pthread_create (&workers[w].pthread, nullptr, worker_main, workers + w))
+        {
+            std::cerr << MSG_PTHREAD_FAIL << std::endl;
+            free_all();
+            exit (FAILURE);
+        }
+    }
+
+    // starts timer
+    sched_lock();
+    decide_tickless (worker, mainThread);
+    sched_unlock();
+    start_timer (worker, mainThread);
+    leave_critical();
     return SUCCESS;
 }
 
@@ -258,7 +898,7 @@ int uthread_init (int quantum_usecs)
  * The thread is added to the end of the READY threads list.
  * The uthread_spawn function should fail if it would cause the number of
  * concurrent threads to exceed the
- * limit (MAX_THREAD_NUM).
+ * limit (MAX_THREAD_NUM, or the limit given to uthread_set_max_threads).
  * Each thread should be allocated with a stack of size STACK_SIZE bytes.
  *
  * @return On success, return the ID of the created thread. On failure,
@@ -266,31 +906,48 @@ int uthread_init (int quantum_usecs)
 */
 int uthread_spawn (thread_entry_point entry_point)
 {
-    block_signals();
-    if (concurrentThreads >= MAX_THREAD_NUM)
+    enter_critical();
+    sched_lock();
+    if (concurrentThreads >= maxThreads)
     {
         std::cerr << MSG_NUM_EXCEED << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
     if (entry_point == nullptr) {
         std::cerr << MSG_ENTRY_POINT_NULL << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    for (int i = 1; i < MAX_THREAD_NUM; ++i)
-    { // i = 0 is taken by the main thread
-        if (ThreadList[i] == nullptr)
-        {
-            ThreadList[i] = new Thread(entry_point);
-            ThreadList[i]->setState (READY);
-            readyList.push_back (i);
-            concurrentThreads++;
-            unblock_signals();
-            return i;
-        }
+    char *stack = stackPool.acquire ();
+    if (stack == nullptr)
+    {
+        std::cerr << MSG_STACK_FAIL << std::endl;
+        free_all();
+        exit (FAILURE);
     }
-    return SUCCESS;
+    // the table gives the smallest free id (0 is taken by the main thread).
+    Thread *thread = threadTable.create (entry_point, stack);
+    if (thread == nullptr)
+    {
+        std::cerr << MSG_THREAD_ALLOC_FAIL << std::endl;
+        free_all();
+        exit (FAILURE);
+    }
+    init_context (&thread->_context, stack, stackPool.stackBytes (), thread_start);
+    // the new thread goes to the run queue of the worker that spawned it.
+    bool preempt = make_ready (thread, current_worker());
+    concurrentThreads++;
+    int tid = thread->getId ();
+    sched_unlock();
+    if (preempt)
+    {
+        switch_out (PREEMPT);
+    }
+    leave_critical();
+    return tid;
 }
 
 
@@ -310,70 +967,48 @@ int uthread_spawn (thread_entry_point entry_point)
 */
 int uthread_terminate (int tid)
 {
-    block_signals();
-    if (tid >= MAX_THREAD_NUM || tid < 0 || ThreadList[tid] == nullptr)
+    enter_critical();
+    sched_lock();
+    if (!valid_tid (tid))
     {
         std::cerr << MSG_INVALID_ID << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
 
     if (tid != 0)
     {
-        concurrentThreads--;
-        if (tid == currentThread)
+        Thread *thread = threadTable.get (tid);
+        if (thread == current_worker()->current)
+        {
+            // the scheduler deletes the thread once it does not run on its stack anymore.
+            sched_unlock();
+            switch_out (TERMINATE_SELF);
+        }
+        else if (thread->getState () == RUNNING)
         {
-            delete ThreadList[tid];
-            ThreadList[tid] = nullptr;
-            int firstElem = readyList.front ();
-            readyList.pop_front ();
-            jump_to_thread (firstElem);
+            // runs on another worker, which deletes it when it switches out.
+            thread->setRequest (TERMINATE_REQUEST);
+            kick_worker (thread);
         }
         else {
-            if (ThreadList[tid]->getState () == READY)
-            {
-                for (unsigned long int i = 0; i < readyList.size (); ++i)
-                {
-                    if (readyList[i] == tid)
-                    {
-                        readyList.erase (readyList.begin () + i);
-                        break;
-                    }
-                }
-            }
-            if (ThreadList[tid]->getState () == BLOCKED)
-            {
-                for (unsigned long int i = 0; i < blockedList.size (); ++i)
-                {
-                    if (blockedList[i] == tid)
-                    {
-                        blockedList.erase (blockedList.begin () + i);
-                        break;
-                    }
-                }
-            }
-            if (ThreadList[tid]->getState () == SLEEP_NOT_BLOCKED)
-            {
-                for (unsigned long int i = 0; i < sleepList.size (); ++i)
-                {
-                    if (sleepList[i] == tid)
-                    {
-                        sleepList.erase (sleepList.begin () + i);
-                        break;
-                    }
-                }
-            }
-            // we delete after checking which list it was because we use getState().
-            delete ThreadList[tid];
-            ThreadList[tid] = nullptr;
+            // the thread is in at most one of the queues, and maybe also in the sleep heap (or
+            // waits for I/O, which delete_thread ends).
+            RunQueue::unlink (thread);
+            ThreadQueue::unlink (thread);
+            sleepHeap.remove (thread);
+            delete_thread (thread);
+            concurrentThreads--;
         }
     }
-    else // terminate main thread and the whole process
+    else // terminate main thread and the whole process (the scheduler stays locked)
     {
         free_all();
         exit (SUCCESS);
     }
-    unblock_signals();
+    sched_unlock();
+    leave_critical();
     return SUCCESS;
 
 }
@@ -393,46 +1028,52 @@ int uthread_terminate (int tid)
 */
 int uthread_block (int tid)
 {
-    block_signals();
+    enter_critical();
+    sched_lock();
     if (tid == 0)
     {
         std::cerr << MSG_BLOCK_MAIN_THREAD << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    if (tid >= MAX_THREAD_NUM || tid < 0 || ThreadList[tid] == nullptr)
+    if (!valid_tid (tid))
     {
         std::cerr << MSG_INVALID_ID << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    if (ThreadList[tid]->getState () == BLOCKED)
+    Thread *thread = threadTable.get (tid);
+    if (thread->getState () == BLOCKED || thread->getRequest () == BLOCK_REQUEST)
     {
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return SUCCESS; //the thread is already blocked
     }
-    if (currentThread != tid)
+    if (thread == current_worker()->current)
+    { //thread is blocking itself
+        sched_unlock();
+        switch_out (BLOCK_SELF);
+        leave_critical();
+        return SUCCESS;
+    }
+    if (thread->getState () == RUNNING)
     {
-        if (ThreadList[tid]->getState () != SLEEP_NOT_BLOCKED)
-        {
-            for (unsigned long int i = 0; i < readyList.size (); ++i)
-            {
-                if (readyList[i] == tid)
-                {
-                    readyList.erase (readyList.begin () + i);
-                }
-            }
-        }
-        ThreadList[tid]->setState (BLOCKED);
-        blockedList.push_back (tid);
+        // runs on another worker, which blocks it when it switches out.
+        thread->setRequest (BLOCK_REQUEST);
+        kick_worker (thread);
     }
     else
-    { //thread is blocking itself
-        ThreadList[tid]->setState (BLOCKED);
-        blockedList.push_back (tid);
-        switch_thread ();
+    {
+        // a sleeping thread (or one that waits for I/O) is in no run queue, and unlink() leaves
+        // it alone.
+        RunQueue::unlink (thread);
+        thread->setState (BLOCKED);
+        blockedList.pushBack (thread);
     }
-    unblock_signals();
+    sched_unlock();
+    leave_critical();
     return SUCCESS;
 }
 
@@ -447,27 +1088,46 @@ int uthread_block (int tid)
 */
 int uthread_resume (int tid)
 {
-    block_signals();
-    if (tid >= MAX_THREAD_NUM || tid < 0 || ThreadList[tid] == nullptr)
+    enter_critical();
+    sched_lock();
+    if (!valid_tid (tid))
     {
         std::cerr << MSG_RESUME_INVALID << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    if (ThreadList[tid]->getState () == BLOCKED &&
-    ThreadList[tid]->getSleepTime () == 0)
+    Thread *thread = threadTable.get (tid);
+    bool preempt = false;
+    if (thread->getRequest () == BLOCK_REQUEST)
     {
-        ThreadList[tid]->setState (READY);
-        readyList.push_back (tid);
-        blockedList.erase (std::remove (blockedList.begin (), blockedList.end (), tid),
-                           blockedList.end ());
+        // the thread still runs on another worker, and was not blocked yet.
+        thread->setRequest (NO_REQUEST);
+    }
+    else if (thread->getState () == BLOCKED)
+    {
+        blockedList.remove (thread);
+        if (thread->isSleeping ())
+        {
+            // the thread goes to a run queue when its sleep ends.
+            thread->setState (SLEEP_NOT_BLOCKED);
+        }
+        else if (thread->isWaitingIo ())
+        {
+            // the thread goes to a run queue when its I/O is ready.
+            thread->setState (IO_WAIT_NOT_BLOCKED);
+        }
+        else
+        {
+            preempt = make_ready (thread, current_worker());
+        }
     }
-    if (ThreadList[tid]->getState () == BLOCKED &&
-    ThreadList[tid]->getSleepTime () > 0)
+    sched_unlock();
+    if (preempt)
     {
-        ThreadList[tid]->setState (SLEEP_NOT_BLOCKED);
+        switch_out (PREEMPT);
     }
-    unblock_signals();
+    leave_critical();
     return SUCCESS;
 }
 
@@ -487,25 +1147,30 @@ int uthread_resume (int tid)
 */
 int uthread_sleep (int num_quantums)
 {
-    block_signals();
+    enter_critical();
+    sched_lock();
     if (num_quantums <= 0)
     {
         std::cerr << MSG_SLEEP_INVALID_TIME << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    if (currentThread == 0)
+    Thread *thread = current_worker()->current;
+    if (thread->getId () == 0)
     {
         std::cerr << MSG_SLEEP_MAIN_THREAD << std::endl;
-        unblock_signals();
+        sched_unlock();
+        leave_critical();
         return FAIL;
     }
-    sleepList.push_back (currentThread);
-    ThreadList[currentThread]->setSleepTime (num_quantums + 1);
-    // +1 because we dont count the current quantum (we decrease it by 1 in the time handler).
-    ThreadList[currentThread]->setState (SLEEP_NOT_BLOCKED);
-    switch_thread ();
-    unblock_signals();
+    catch_up (current_worker());
+    // +1 because we dont count the current quantum (totalNumQuantums grows when the next one starts).
+    thread->setWakeQuantum (totalNumQuantums + num_quantums + 1);
+    sched_unlock();
+    // the scheduler puts the thread into the sleep heap once it switched out.
+    switch_out (SLEEP_SELF);
+    leave_critical();
     return SUCCESS;
 }
 
@@ -516,7 +1181,11 @@ int uthread_sleep (int num_quantums)
 */
 int uthread_get_tid ()
 {
-    return currentThread;
+    // a critical section, so the thread does not move to another worker in the middle.
+    enter_critical();
+    int tid = current_worker()->current->getId ();
+    leave_critical();
+    return tid;
 }
 
 /**
@@ -529,7 +1198,13 @@ int uthread_get_tid ()
 */
 int uthread_get_total_quantums ()
 {
-    return totalNumQuantums;
+    enter_critical();
+    sched_lock();
+    catch_up (current_worker());
+    int total = totalNumQuantums;
+    sched_unlock();
+    leave_critical();
+    return total;
 }
 
 /**
@@ -543,12 +1218,318 @@ int uthread_get_total_quantums ()
 */
 int uthread_get_quantums (int tid)
 {
-    block_signals();
-    if (tid >= MAX_THREAD_NUM || tid < 0 || ThreadList[tid] == nullptr)
+    enter_critical();
+    sched_lock();
+    if (!valid_tid (tid))
     {
         std::cerr << MSG_GET_QUANTUMS << std::endl;
+        sched_unlock();
+        leave_critical();
+        return FAIL;
+    }
+    catch_up (current_worker());
+    int quantums = (int) threadTable.get (tid)->getQuantums ();
+    sched_unlock();
+    leave_critical();
+    return quantums;
+}
+
+/**
+ * @brief Turns the tickless mode on or off, see uthreads_ext.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_tickless (int enabled)
+{
+    if (workers != nullptr)
+    {
+        std::cerr << MSG_TICKLESS_AFTER_INIT << std::endl;
+        return FAIL;
+    }
+    ticklessMode = enabled != 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief Sets the most threads that may exist at once, see uthreads_ext.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_max_threads (int max_threads)
+{
+    if (workers != nullptr)
+    {
+        std::cerr << MSG_MAX_THREADS_AFTER_INIT << std::endl;
+        return FAIL;
+    }
+    if (max_threads <= 0)
+    {
+        std::cerr << MSG_MAX_THREADS_INVALID << std::endl;
+        return FAIL;
+    }
+    maxThreads = max_threads;
+    return SUCCESS;
+}
+
+/**
+ * @brief Sets the priority of the thread with ID tid, see uthreads_ext.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority (int tid, int priority)
+{
+    enter_critical();
+    sched_lock();
+    if (!valid_tid (tid))
+    {
+        std::cerr << MSG_INVALID_ID << std::endl;
+        sched_unlock();
+        leave_critical();
+        return FAIL;
+    }
+    if (priority < 0 || priority >= NUM_PRIORITIES)
+    {
+        std::cerr << MSG_PRIORITY_INVALID << std::endl;
+        sched_unlock();
+        leave_critical();
+        return FAIL;
+    }
+    Thread *thread = threadTable.get (tid);
+    Worker *worker = current_worker();
+    RunQueue *queue = thread->getRunQueue ();
+    bool preempt = false;
+    if (queue != nullptr)
+    {
+        // a queued thread is requeued by its new priority.
+        queue->remove (thread);
+        thread->setPriority (priority);
+        queue->push (thread);
+        if (queue == worker->runQueue)
+        {
+            charge_current (worker);
+            preempt = queue->preempts (thread, worker->current);
+        }
+    }
+    else
+    {
+        thread->setPriority (priority);
+    }
+    sched_unlock();
+    if (preempt)
+    {
+        switch_out (PREEMPT);
+    }
+    leave_critical();
+    return SUCCESS;
+}
+
+/**
+ * @brief Sets the length of the quanta of the thread with ID tid, see uthreads_ext.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_quantum (int tid, int quantum_usecs)
+{
+    enter_critical();
+    sched_lock();
+    if (!valid_tid (tid))
+    {
+        std::cerr << MSG_INVALID_ID << std::endl;
+        sched_unlock();
+        leave_critical();
+        return FAIL;
+    }
+    if (quantum_usecs <= 0)
+    {
+        std::cerr << MSG_NON_POSITIVE << std::endl;
+        sched_unlock();
+        leave_critical();
+        return FAIL;
+    }
+    threadTable.get (tid)->setQuantumUsecs (quantum_usecs);
+    sched_unlock();
+    leave_critical();
+    return SUCCESS;
+}
+
+/**
+ * @brief Moves the RUNNING thread back to the READY threads, see uthreads_ext.h.
+ *
+ * @return On success, return 0.
+*/
+int uthread_yield ()
+{
+    enter_critical();
+    switch_out (YIELD_SELF);
+    leave_critical();
+    return SUCCESS;
+}
+
+/**
+ * switches fd to non-blocking mode, if it is not.
+ * @return 0 on success, -1 on failure (errno is set).
+ **/
+int set_nonblocking(int fd) {
+    int flags = fcntl (fd, F_GETFL);
+    if (flags < 0)
+    {
+        return FAIL;
+    }
+    if (!(flags & O_NONBLOCK) && fcntl (fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return FAIL;
+    }
+    return SUCCESS;
+}
+
+/**
+ * true if a system call on a non-blocking fd failed because the fd is not ready.
+ **/
+bool would_block(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+/**
+ * makes the running thread wait until fd is ready for reading (or writing, if write). The reactor
+ * takes the thread once it switched out (or right away, if the I/O got ready meanwhile).
+ * @return 0 when the thread should try its system call again, -1 if fd cannot be waited on
+ * (errno is set).
+ **/
+int wait_io(int fd, bool write) {
+    enter_critical();
+    sched_lock();
+    if (reactor.wait (current_worker()->current, fd, write))
+    {
+        int error = errno;
+        sched_unlock();
+        leave_critical();
+        // (errno of the kernel thread the thread runs on now.)
+        errno = error;
+        return FAIL;
+    }
+    sched_unlock();
+    switch_out (WAIT_IO_SELF);
+    leave_critical();
+    return SUCCESS;
+}
+
+/**
+ * @brief read(2) that blocks only the calling thread, see uthreads_io.h.
+ *
+ * @return On success, the number of bytes read. On failure, return -1.
+*/
+ssize_t uthread_read (int fd, void *buf, size_t count)
+{
+    if (set_nonblocking (fd))
+    {
+        return FAIL;
+    }
+    while (true)
+    {
+        ssize_t done = read (fd, buf, count);
+        if (done >= 0 || (errno != EINTR && !would_block (errno)))
+        {
+            return done;
+        }
+        if (errno != EINTR && wait_io (fd, false))
+        {
+            return FAIL;
+        }
+    }
+}
+
+/**
+ * @brief write(2) that blocks only the calling thread, see uthreads_io.h.
+ *
+ * @return On success, the number of bytes written. On failure, return -1.
+*/
+ssize_t uthread_write (int fd, const void *buf, size_t count)
+{
+    if (set_nonblocking (fd))
+    {
         return FAIL;
     }
-    unblock_signals();
-    return (int) ThreadList[tid]->getQuantums ();
+    while (true)
+    {
+        ssize_t done = write (fd, buf, count);
+        if (done >= 0 || (errno != EINTR && !would_block (errno)))
+        {
+            return done;
+        }
+        if (errno != EINTR && wait_io (fd, true))
+        {
+            return FAIL;
+        }
+    }
+}
+
+/**
+ * @brief accept(2) that blocks only the calling thread, see uthreads_io.h.
+ *
+ * @return On success, the fd of the accepted socket. On failure, return -1.
+*/
+int uthread_accept (int fd, struct sockaddr *addr, socklen_t *addrlen)
+{
+    if (set_nonblocking (fd))
+    {
+        return FAIL;
+    }
+    while (true)
+    {
+        int socket = accept (fd, addr, addrlen);
+        if (socket >= 0 || (errno != EINTR && !would_block (errno)))
+        {
+            return socket;
+        }
+        if (errno != EINTR && wait_io (fd, false))
+        {
+            return FAIL;
+        }
+    }
+}
+
+/**
+ * @brief connect(2) that blocks only the calling thread, see uthreads_io.h.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_connect (int fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    if (set_nonblocking (fd))
+    {
+        return FAIL;
+    }
+    if (connect (fd, addr, addrlen) == 0)
+    {
+        return SUCCESS;
+    }
+    // a non-blocking connect goes on in the background (also after EINTR), and the socket gets
+    // writable when it is done.
+    if (errno != EINPROGRESS && errno != EINTR)
+    {
+        return FAIL;
+    }
+    while (true)
+    {
+        int error = 0;
+        socklen_t length = sizeof (error);
+        if (wait_io (fd, true) || getsockopt (fd, SOL_SOCKET, SO_ERROR, &error, &length))
+        {
+            return FAIL;
+        }
+        if (error != 0)
+        {
+            errno = error;
+            return FAIL;
+        }
+        // connected, unless the wait ended before the connection was done (then EALREADY).
+        if (connect (fd, addr, addrlen) == 0 || errno == EISCONN)
+        {
+            return SUCCESS;
+        }
+        if (errno != EALREADY && errno != EINTR)
+        {
+            return FAIL;
+        }
+    }
 }
@@ -0,0 +1,103 @@
+#ifndef UTHREADS_EXT_H
+#define UTHREADS_EXT_H
+#include "uthreads.h"
+
+#define NUM_PRIORITIES 8
+// 0 is the highest priority. New threads (and the main thread) get DEFAULT_PRIORITY.
+#define DEFAULT_PRIORITY 4
+
+/**
+ * the scheduling policies, see uthread_init_policy.
+ */
+enum SchedPolicy {
+    // one FIFO queue, every thread runs a quantum in turn (the policy of uthread_init).
+    POLICY_ROUND_ROBIN,
+    // a FIFO queue per priority: the highest priority ready thread always runs.
+    POLICY_PRIORITY,
+    // weighted fair: the thread that ran the least (scaled by the weight of its priority) runs.
+    POLICY_FAIR
+};
+
+/**
+ * @brief initializes the thread library with a scheduling policy.
+ *
+ * Call it instead of uthread_init / uthread_init_mn (uthread_init_mn(quantum_usecs, num_workers) is
+ * uthread_init_policy(quantum_usecs, num_workers, POLICY_ROUND_ROBIN)).
+ * - POLICY_PRIORITY: a thread that becomes READY (spawned, resumed or woken up) with a higher
+ *   priority than the thread running on its worker preempts it right away.
+ * - POLICY_FAIR: every thread has a virtual runtime, its running time scaled by the weight of its
+ *   priority (each priority gets about 1.5 times the cpu of the next one), and the thread with
+ *   the smallest virtual runtime runs next. A thread that slept is placed at most one quantum
+ *   behind the others, so it runs soon after it wakes up (and preempts the running thread if that
+ *   one is ahead of it by more than half a quantum) but cannot save up cpu time while it sleeps.
+ * With several workers every worker applies the policy to its own run queue only.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_policy (int quantum_usecs, int num_workers, SchedPolicy policy);
+
+/**
+ * @brief Turns the tickless mode on (enabled != 0) or off. Must be called before the library is
+ * initialized.
+ *
+ * In tickless mode a worker that runs a thread with no other READY thread in its run queue does
+ * not tick: its timer is off, or programmed for the quantum the next sleeping thread wakes up in.
+ * A thread that runs alone is not interrupted by the timer at all (and pays no signals) until
+ * another thread becomes READY on its worker, when the ticks start again from the end of its
+ * current quantum.
+ * The quanta that are not ticked are still counted (from the cpu time of the worker), so the
+ * quantum counts and uthread_sleep behave as with ticks; a count read while another worker runs
+ * a thread alone may miss the quanta that worker did not count yet.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_tickless (int enabled);
+
+/**
+ * @brief Sets the most threads that may exist at once (the main thread included) instead of
+ * MAX_THREAD_NUM. Must be called before the library is initialized.
+ *
+ * The thread table grows with the number of threads, so the limit only bounds how many threads
+ * uthread_spawn creates: every thread costs its stack (STACK_SIZE and room for signal frames,
+ * of which only the pages it touches are in memory) and about a hundred bytes in the table.
+ * IDs are given as with MAX_THREAD_NUM, the smallest free ID first.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_max_threads (int max_threads);
+
+/**
+ * @brief Sets the priority of the thread with ID tid (0 is the highest, NUM_PRIORITIES - 1 the
+ * lowest). POLICY_ROUND_ROBIN ignores priorities.
+ *
+ * A READY thread is requeued by its new priority (and preempts the calling thread if it should
+ * now); for a RUNNING thread the priority takes effect when it switches out.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_priority (int tid, int priority);
+
+/**
+ * @brief Sets the length of the quanta of the thread with ID tid, in micro-seconds, instead of the
+ * quantum given to uthread_init. It takes effect from the next quantum of the thread.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_set_quantum (int tid, int quantum_usecs);
+
+/**
+ * @brief Gives up the cpu: the RUNNING thread goes back to the READY threads and a scheduling
+ * decision is made, exactly as if its quantum had ended (a new quantum starts and is counted). If no other thread should run before it (no other thread is READY, or with
+ * POLICY_PRIORITY / POLICY_FAIR no other thread comes first), the calling thread runs again
+ * right away.
+ *
+ * The next thread gets the rest of the quantum of the calling thread: the timer is not armed
+ * again, unless the next thread has a quantum of another length or runs alone in tickless mode.
+ * So the switch saves and restores the registers only, with no system call, and it is the cheap
+ * way for threads to pass control to each other.
+ *
+ * @return On success, return 0.
+*/
+int uthread_yield ();
+
+#endif //UTHREADS_EXT_H
@@ -0,0 +1,52 @@
+#ifndef UTHREADS_IO_H
+#define UTHREADS_IO_H
+#include "uthreads.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * I/O that blocks only the calling thread. The system calls below block the kernel thread that
+ * makes them, and with it all the threads of its worker; these wrappers make the same calls, but
+ * when the fd is not ready the calling thread waits for it in an epoll reactor and the other
+ * threads run meanwhile. The reactor is polled whenever a worker switches threads, and a worker
+ * with no thread to run sleeps in it, so a thread runs again soon after its fd is ready.
+ * - the fd is switched to non-blocking mode (O_NONBLOCK), and stays so.
+ * - a thread that waits for I/O is in no READY queue. Blocking it and resuming it works as with
+ *   uthread_sleep: a blocked thread whose I/O became ready waits for uthread_resume, and
+ *   resuming a thread that waits for I/O has no effect.
+ * - the fd must support epoll (sockets, pipes, ttys...). Regular files are always ready, so the
+ *   wrappers just read and write them.
+ * - closing an fd while a thread waits on it leaves the thread waiting.
+ * The wrappers return what the system calls return, and set errno as they do (EINTR is retried).
+ */
+
+/**
+ * @brief read(2) that blocks only the calling thread.
+ *
+ * @return On success, the number of bytes read (0 at end of file). On failure, return -1.
+*/
+ssize_t uthread_read (int fd, void *buf, size_t count);
+
+/**
+ * @brief write(2) that blocks only the calling thread. Like write, it may write less than count
+ * bytes.
+ *
+ * @return On success, the number of bytes written. On failure, return -1.
+*/
+ssize_t uthread_write (int fd, const void *buf, size_t count);
+
+/**
+ * @brief accept(2) that blocks only the calling thread. The new socket is blocking, as with accept.
+ *
+ * @return On success, the fd of the accepted socket. On failure, return -1.
+*/
+int uthread_accept (int fd, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief connect(2) that blocks only the calling thread.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_connect (int fd, const struct sockaddr *addr, socklen_t addrlen);
+
+#endif //UTHREADS_IO_H
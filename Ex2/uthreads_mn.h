@@ -0,0 +1,27 @@
+#ifndef UTHREADS_MN_H
+#define UTHREADS_MN_H
+#include "uthreads.h"
+
+#define MAX_WORKERS 256
+
+/**
+ * @brief initializes the thread library in M:N mode: the user threads run on num_workers kernel
+ * threads (workers), so CPU bound threads run on several cores at the same time.
+ *
+ * Call it instead of uthread_init (uthread_init(quantum_usecs) is uthread_init_mn(quantum_usecs, 1)).
+ * The calling thread becomes the main thread (tid == 0) on the first worker. Every worker has its
+ * own run queue: spawned and resumed threads go to the queue of the calling worker, preempted
+ * threads to the queue of the worker they ran on, and a worker with an empty queue steals from the
+ * others. The rest of the API is unchanged, with these differences:
+ * - a quantum is quantum_usecs of cpu time of the worker that runs the thread, and the total
+ *   number of quantums counts the quantums started on all the workers.
+ * - blocking or terminating a thread that runs on another worker interrupts that worker, and
+ *   takes effect when the thread switches out (right after the call returns).
+ * - a thread can move to another kernel thread whenever it switches out, so it must not keep
+ *   kernel thread state (errno, thread_local variables) across a point where it may be preempted.
+ *
+ * @return On success, return 0. On failure, return -1.
+*/
+int uthread_init_mn (int quantum_usecs, int num_workers);
+
+#endif //UTHREADS_MN_H
@@ -1,48 +1,82 @@
 #include "Barrier.h"
 #include <cstdlib>
 #include <cstdio>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
-Barrier::Barrier(int numThreads)
-		: mutex(PTHREAD_MUTEX_INITIALIZER)
-		, cv(PTHREAD_COND_INITIALIZER)
-		, count(0)
-		, numThreads(numThreads)
-{ }
+// the number of checks of the generation before sleeping, if every thread has its own cpu.
+#define BARRIER_SPIN_LIMIT 4000
 
+/**
+ * tells the cpu that we are in a spin loop (so it does not slow down the other hyperthread).
+ */
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
 
-Barrier::~Barrier()
+static void futex_wait(std::atomic<int> *word, int value)
 {
-	if (pthread_mutex_destroy(&mutex) != 0) {
-		fprintf(stderr, "[[Barrier]] error on pthread_mutex_destroy");
+	if (syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAIT_PRIVATE, value,
+	            nullptr, nullptr, 0) != 0 && errno != EAGAIN && errno != EINTR) {
+		fprintf(stderr, "[[Barrier]] error on futex wait");
 		exit(1);
 	}
-	if (pthread_cond_destroy(&cv) != 0){
-		fprintf(stderr, "[[Barrier]] error on pthread_cond_destroy");
+}
+
+static void futex_wake_all(std::atomic<int> *word)
+{
+	if (syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAKE_PRIVATE, INT_MAX,
+	            nullptr, nullptr, 0) < 0) {
+		fprintf(stderr, "[[Barrier]] error on futex wake");
 		exit(1);
 	}
 }
 
+Barrier::Barrier(int numThreads)
+		: count(0)
+		, generation(0)
+		, sleepers(0)
+		, numThreads(numThreads)
+		, spinLimit(numThreads <= sysconf(_SC_NPROCESSORS_ONLN) ? BARRIER_SPIN_LIMIT : 0)
+{ }
+
+
+Barrier::~Barrier()
+{ }
+
 
 void Barrier::barrier()
 {
-	if (pthread_mutex_lock(&mutex) != 0){
-		fprintf(stderr, "[[Barrier]] error on pthread_mutex_lock");
-		exit(1);
-	}
-	if (++count < numThreads) {
-		if (pthread_cond_wait(&cv, &mutex) != 0){
-			fprintf(stderr, "[[Barrier]] error on pthread_cond_wait");
-			exit(1);
+	// read before arriving: the generation cannot change until we arrive.
+	int current = generation.load(std::memory_order_acquire);
+	if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == numThreads) {
+		// the last thread: reset the count for the next generation, then release this one.
+		count.store(0, std::memory_order_relaxed);
+		generation.fetch_add(1, std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_seq_cst) > 0) {
+			futex_wake_all(&generation);
 		}
-	} else {
-		count = 0;
-		if (pthread_cond_broadcast(&cv) != 0) {
-			fprintf(stderr, "[[Barrier]] error on pthread_cond_broadcast");
-			exit(1);
+		return;
+	}
+	for (int i = 0; i < spinLimit; ++i) {
+		if (generation.load(std::memory_order_acquire) != current) {
+			return;
 		}
+		cpu_relax();
 	}
-	if (pthread_mutex_unlock(&mutex) != 0) {
-		fprintf(stderr, "[[Barrier]] error on pthread_mutex_unlock");
-		exit(1);
+	// sleepers is raised before the futex checks the generation, so the last thread either
+	// sees a sleeper and wakes it, or changed the generation before the check.
+	sleepers.fetch_add(1, std::memory_order_seq_cst);
+	while (generation.load(std::memory_order_seq_cst) == current) {
+		futex_wait(&generation, current);
 	}
+	sleepers.fetch_sub(1, std::memory_order_relaxed);
 }
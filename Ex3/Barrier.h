@@ -1,8 +1,11 @@
 #ifndef BARRIER_H
 #define BARRIER_H
-#include <pthread.h>
+#include <atomic>
 
-// a multiple use barrier
+// a multiple use barrier.
+// a thread that arrives spins for a while until the last thread of its generation arrives,
+// and then sleeps on a futex, so the last thread wakes everybody with a single system call
+// (and with none if nobody slept).
 
 class Barrier {
 public:
@@ -11,10 +14,17 @@ public:
 	void barrier();
 
 private:
-	pthread_mutex_t mutex;
-	pthread_cond_t cv;
-	int count;
+	// the number of threads that arrived in the current generation.
+	std::atomic<int> count;
+	// the futex word: changed by the last thread of every generation, and its change releases
+	// the others (the sense of a sense reversing barrier).
+	std::atomic<int> generation;
+	// the number of threads that sleep (or are about to sleep) on the futex.
+	std::atomic<int> sleepers;
 	int numThreads;
+	// how many times a thread checks the generation before it sleeps (0 when there are more
+	// threads than cpus, since spinning then takes the cpu of the thread we wait for).
+	int spinLimit;
 };
 
 #endif //BARRIER_H
@@ -0,0 +1,121 @@
+#ifndef JOBCONFIG_H
+#define JOBCONFIG_H
+#include <cstdint>
+#include <cstdio>
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+
+/**
+ * the different ways the framework can group the intermediate pairs by key.
+ * MERGE_SHUFFLE - every thread sorts its own pairs and thread 0 merges them alone.
+ * HASH_SHUFFLE - every thread partitions its pairs into buckets by ClientHooks::hashKey,
+ *                thread i then groups and reduces bucket i.
+ * PIPELINED_SHUFFLE - like HASH_SHUFFLE, with more partitions than threads and no barriers
+ *                     between map, shuffle and reduce: once every thread finished mapping,
+ *                     each partition is grouped and reduced by the first free thread. Reduce
+ *                     does not overlap the map phase (a key may come from any input pair).
+ * SAMPLE_SHUFFLE - every thread sorts its own pairs and samples their keys. The samples give
+ *                  MT_LEVEL - 1 splitters, and thread i merges and reduces the pairs of all the
+ *                  threads between splitters i - 1 and i, so the ranges are ordered by thread id.
+ */
+enum shuffle_t {
+    MERGE_SHUFFLE,
+    HASH_SHUFFLE,
+    PIPELINED_SHUFFLE,
+    SAMPLE_SHUFFLE
+};
+
+/**
+ * optional hooks that a client may implement in addition to MapReduceClient.
+ * a client that uses them usually inherits from both classes.
+ */
+class ClientHooks {
+public:
+    virtual ~ClientHooks () {}
+
+    /**
+     * hash of an intermediate key. equal keys must have equal hashes.
+     * must be overridden for HASH_SHUFFLE and PIPELINED_SHUFFLE (the default puts all the keys in one bucket).
+     */
+    virtual uint64_t hashKey (const K2 *key) const { return 0; }
+
+    /**
+     * combines the pairs of one key that one thread emitted, before the shuffle.
+     * called with a sequence of pairs with identical keys, it should call emit2 with pairs of the
+     * same key only (usually a single one), and it owns the given pairs just like reduce does.
+     * needed only when JobConfig::combine is set (the default passes the pairs on unchanged).
+     */
+    virtual void combine (const IntermediateVec *pairs, void *context) const
+    {
+      for (const IntermediatePair &pair : *pairs)
+        {
+          emit2 (pair.first, pair.second, context);
+        }
+    }
+
+    /**
+     * writes an intermediate pair to a spill file, so it can be read back by readPair.
+     * the pair belongs to the framework from the moment emit2 is called: once the pair is
+     * written, the framework deletes its key and value, so they must not be used afterwards.
+     * needed only when JobConfig::spillThreshold is set.
+     * @return true on success, false on failure (the default).
+     */
+    virtual bool writePair (const K2 *key, const V2 *value, FILE *file) const { return false; }
+
+    /**
+     * reads the next pair written by writePair, into new K2 and V2 objects. They are passed to
+     * reduce like any other pair, which owns them.
+     * needed only when JobConfig::spillThreshold is set.
+     * @return true if a pair was read, false at the end of the file.
+     */
+    virtual bool readPair (FILE *file, K2 **key, V2 **value) const { return false; }
+
+    /**
+     * a fixed width prefix of a key that keeps the order of the keys: if *a < *b then
+     * sortPrefix(a) <= sortPrefix(b) (for example the first 8 bytes of a string, big endian).
+     * the pairs are sorted by it with a radix sort, and K2::operator< is called only for pairs
+     * with equal prefixes. needed only when JobConfig::prefixSort is set.
+     */
+    virtual uint64_t sortPrefix (const K2 *key) const { return 0; }
+};
+
+/**
+ * parameters of a single job. the default values give the original behaviour.
+ */
+struct JobConfig {
+    shuffle_t shuffle;
+    // run ClientHooks::combine on the sorted pairs of every thread before the shuffle.
+    bool combine;
+    // keep the output pairs in the order of their intermediate keys (MERGE_SHUFFLE and
+    // SAMPLE_SHUFFLE only).
+    // otherwise the output of every thread is appended as one block.
+    bool orderedOutput;
+    // when a thread holds this many intermediate pairs, they are sorted and written to a run
+    // file with ClientHooks::writePair, and the shuffle merges the runs from the disk
+    // (MERGE_SHUFFLE only). 0 keeps everything in memory.
+    size_t spillThreshold;
+    // sort the intermediate pairs by ClientHooks::sortPrefix instead of only with K2::operator<.
+    bool prefixSort;
+    // JobPool only: a job of a higher priority that waits for threads preempts the jobs of lower
+    // priorities between two map items.
+    int priority;
+    // JobPool only: the part of the pool threads the job gets when it starts, relative to the
+    // weights of the other jobs that run or wait in the pool (0 counts as 1).
+    unsigned int weight;
+    // pin thread i of the job to a cpu, filling the cpus of one NUMA node before the next, so
+    // the buffers of every thread are allocated on its node (see createJobPool for pools).
+    // this keeps map and sort local with any shuffle, and the grouping with HASH_SHUFFLE and
+    // SAMPLE_SHUFFLE; MERGE_SHUFFLE still merges every thread's pairs on thread 0.
+    bool pinThreads;
+    const ClientHooks *hooks;
+
+    JobConfig () : shuffle (MERGE_SHUFFLE), combine (false), orderedOutput (false), spillThreshold (0),
+                   prefixSort (false), priority (0), weight (1),
+                   pinThreads (false), hooks (nullptr) {}
+};
+
+JobHandle startMapReduceJob (const MapReduceClient &client,
+                             const InputVec &inputVec, OutputVec &outputVec,
+                             int multiThreadLevel, const JobConfig &config);
+
+#endif //JOBCONFIG_H
@@ -0,0 +1,27 @@
+#ifndef JOBPOOL_H
+#define JOBPOOL_H
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+#include "JobConfig.h"
+
+/**
+ * a pool of worker threads that is created once and runs many jobs at the same time.
+ * submitting a job to a pool does not create any thread: a job starts when some workers are
+ * idle and runs on its share of them (see JobConfig::weight), and a job of a higher priority
+ * (JobConfig::priority) takes workers from the jobs of lower priorities between map items.
+ */
+typedef void *JobPoolHandle;
+
+/**
+ * @param pinThreads pin every worker to a cpu like JobConfig::pinThreads does for a job
+ * (JobConfig::pinThreads is ignored for pool jobs).
+ */
+JobPoolHandle createJobPool (int multiThreadLevel, bool pinThreads = false);
+
+JobHandle submitMapReduceJob (JobPoolHandle pool, const MapReduceClient &client,
+                              const InputVec &inputVec, OutputVec &outputVec,
+                              const JobConfig &config = JobConfig ());
+
+void closeJobPool (JobPoolHandle pool);
+
+#endif //JOBPOOL_H
@@ -0,0 +1,49 @@
+#ifndef JOBSTATS_H
+#define JOBSTATS_H
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "MapReduceFramework.h"
+
+/**
+ * what one worker thread of a job did so far. All the times are in nanoseconds.
+ */
+struct ThreadStats {
+    uint64_t mapNs;
+    // sorting, combining and partitioning the pairs of the thread after map.
+    uint64_t sortNs;
+    // waiting for the other threads at barriers.
+    uint64_t barrierNs;
+    uint64_t shuffleNs;
+    // reducing, and copying the output of the thread into the output vector.
+    uint64_t reduceNs;
+    // waiting for the reduce mutex and its condition variable.
+    uint64_t lockWaitNs;
+    // the number of emit2 calls of the thread from map.
+    uint64_t pairsEmitted;
+    // the number of emit2 calls of the thread from ClientHooks::combine.
+    uint64_t pairsCombined;
+    // the peak size of the framework buffers of the thread (pairs, buckets, output).
+    uint64_t bytesAllocated;
+};
+
+/**
+ * the state of a job together with the statistics of every thread, see getJobStats.
+ */
+struct JobStats {
+    JobState state;
+    std::vector<ThreadStats> threads;
+};
+
+/**
+ * fills stats with the current state and per thread statistics of a job.
+ * can be called at any time until closeJobHandle, also while the job runs.
+ */
+void getJobStats (JobHandle job, JobStats *stats);
+
+/**
+ * writes the statistics of a job to file as a single JSON object.
+ */
+void dumpJobStats (JobHandle job, FILE *file);
+
+#endif //JOBSTATS_H
@@ -1,11 +1,18 @@
 #include <atomic>
+#include <chrono>
 #include "iostream"
 #include <pthread.h>
+#include <sched.h>
 #include <algorithm>
 #include <queue>
+#include <climits>
 #include "MapReduceFramework.h"
 #include "MapReduceClient.h"
 #include "Barrier.h"
+#include "JobConfig.h"
+#include "JobPool.h"
+#include "JobStats.h"
+#include "StreamJob.h"
 
 /**
  * constants
@@ -15,14 +22,129 @@
 #define PTHREAD_JOIN_FAIL_MSG "system error: pthread_join function failed\n"
 #define PTHREAD_DESTROY_FAIL_MSG "system error: error on pthread_mutex_destroy"
 #define PTHREAD_CREATE_FAIL_MSG "system error: pthread create function failed\n"
+#define NO_HOOKS_FAIL_MSG "system error: the job configuration needs client hooks\n"
+#define AFFINITY_FAIL_MSG "system error: failed to get or set the cpu affinity of a thread\n"
+// pinThreads: the cpus of every NUMA node are listed here (like "0-3,8-11").
+#define NODE_CPULIST_PATH "/sys/devices/system/node/node%d/cpulist"
+#define MAX_NUMA_NODES 256
+#define CACHE_LINE_SIZE 64
+// the owner of a map range claims 1 / MAP_CHUNK_DIVISOR of what is left in it every time.
+#define MAP_CHUNK_DIVISOR 4
+// in spill mode, the number of merged groups that may wait for reduce before the merging
+// thread reduces groups by itself.
+#define SPILL_QUEUE_GROUPS 1024
+// PIPELINED_SHUFFLE splits the keys into MT_LEVEL * PARTITIONS_PER_THREAD partitions, so a free
+// thread can take a partition while the others still work on theirs.
+#define PARTITIONS_PER_THREAD 4
+// SAMPLE_SHUFFLE: the number of keys every thread contributes for choosing the splitters.
+// more samples per splitter give ranges of more equal sizes.
+#define SAMPLES_PER_THREAD 16
+// prefixSort: fewer pairs than this are sorted with std::sort, the radix sort does not pay off.
+#define RADIX_SORT_MIN_PAIRS 256
+// prefixSort: the radix sort goes over the 64 bit prefix one byte at a time.
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define PTHREAD_COND_FAIL_MSG "system error: error on pthread condition variable\n"
+#define SPILL_FILE_FAIL_MSG "system error: failed to create a spill file\n"
+#define SPILL_WRITE_FAIL_MSG "system error: failed to write a pair to a spill file\n"
+#define SPILL_SHUFFLE_FAIL_MSG "system error: spilling is supported only with MERGE_SHUFFLE\n"
+#define STREAM_CONFIG_FAIL_MSG "system error: stream jobs support neither spilling nor ordered output\n"
+#define ORDERED_OUTPUT_FAIL_MSG "system error: ordered output is supported only with MERGE_SHUFFLE and SAMPLE_SHUFFLE\n"
 
 /**
  * typedef
  */
 typedef struct ThreadContext ThreadContext;
 typedef struct JobContext JobContext;
+typedef struct OutputRun OutputRun;
+typedef struct JobPool JobPool;
+typedef struct PoolWorker PoolWorker;
+typedef struct StreamJob StreamJob;
+typedef struct MapRange MapRange;
+typedef struct GroupSpan GroupSpan;
+typedef struct SpillReader SpillReader;
+typedef struct ThreadCounters ThreadCounters;
+typedef struct PrefixEntry PrefixEntry;
 typedef void *JobHandle;
 
+/**
+ * a range [begin, end) of the output buffer of a thread that is copied to outputVec at
+ * position dest. rank is the place of the run in the final output.
+ */
+struct OutputRun {
+    size_t rank;
+    size_t begin;
+    size_t end;
+    size_t dest;
+};
+
+/**
+ * a sequence of pairs with identical keys, stored at [begin, end) of a flat buffer of pairs
+ * (the arena of the job, or the bucket of a thread with HASH_SHUFFLE).
+ */
+struct GroupSpan {
+    size_t begin;
+    size_t end;
+};
+
+/**
+ * the statistics of one thread in a job (see ThreadStats). Each counter is written only by its
+ * thread, with relaxed atomics, so getJobStats can read them while the job runs.
+ * padded to two cache lines, so the counters of different threads rarely share a line.
+ */
+struct ThreadCounters {
+    std::atomic<uint64_t> mapNs;
+    std::atomic<uint64_t> sortNs;
+    std::atomic<uint64_t> barrierNs;
+    std::atomic<uint64_t> shuffleNs;
+    std::atomic<uint64_t> reduceNs;
+    std::atomic<uint64_t> lockWaitNs;
+    std::atomic<uint64_t> pairsEmitted;
+    std::atomic<uint64_t> pairsCombined;
+    std::atomic<uint64_t> bytesAllocated;
+    char padding[2 * CACHE_LINE_SIZE - 9 * sizeof (std::atomic<uint64_t>)];
+};
+
+/**
+ * prefixSort: the sort prefix of the key of a pair and the place of the pair in the vector
+ * being sorted. The radix sort moves these 16 bytes around instead of the pairs, and never
+ * touches the keys themselves.
+ */
+struct PrefixEntry {
+    uint64_t prefix;
+    size_t index;
+};
+
+/**
+ * the state of reading one spilled run: the file and the pair that was read last from it.
+ */
+struct SpillReader {
+    FILE *file;
+    IntermediatePair current;
+};
+
+/**
+ * orders spill readers by their current key, so a priority_queue of them gives the reader
+ * with the smallest key on top.
+ */
+struct ReaderKeyCmp {
+    bool operator() (const SpillReader &first, const SpillReader &second) const
+    {
+      return *second.current.first < *first.current.first;
+    }
+};
+
+/**
+ * the part [begin, end) of inputVec that a thread still has to map, packed into one word as
+ * (begin << 32 | end) so the owner (taking from the front) and thieves (taking from the back)
+ * can both claim input with a single compare-and-swap.
+ * padded to a cache line so the threads do not share the line of their ranges.
+ */
+struct MapRange {
+    std::atomic<uint64_t> range;
+    char padding[CACHE_LINE_SIZE - sizeof (std::atomic<uint64_t>)];
+};
+
 /**
  * struct which includes all the parameters which are relevant to the thread.
  * Each thread has its own thread context.
@@ -31,6 +153,37 @@ struct ThreadContext {
     int id;
     JobContext *jobC;
     IntermediateVec *intermediateVec;
+    // HASH_SHUFFLE: buckets[i] holds the pairs of this thread that thread i groups.
+    // PIPELINED_SHUFFLE: buckets[p] holds the pairs of this thread in partition p.
+    IntermediateVec *buckets;
+    // HASH_SHUFFLE and SAMPLE_SHUFFLE: the groups this thread made from its bucket or key range
+    // (kept sorted in intermediateVec) and reduces by itself.
+    std::vector<GroupSpan> *ownGroups;
+    // SAMPLE_SHUFFLE only: the keys this thread sampled from its sorted pairs, and the pairs of
+    // all the threads in the key range of this thread (until they replace intermediateVec).
+    std::vector<K2 *> *samples;
+    IntermediateVec *keyRange;
+    // prefixSort only: buffers of sort_pairs, kept for the next sort.
+    std::vector<PrefixEntry> *prefixes;
+    std::vector<PrefixEntry> *prefixesTmp;
+    IntermediateVec *sortedPairs;
+    // stream jobs only: the state of the keys of this thread (their combined pairs), sorted.
+    IntermediateVec *state;
+    // the group being reduced is copied here, so no vector is allocated per key.
+    IntermediateVec *reduceVec;
+    // emit3 writes here without locking, the buffers are spliced into outputVec after reduce.
+    OutputVec *outputVec;
+    // orderedOutput only: the output of every group this thread reduced.
+    std::vector<OutputRun> *outputRuns;
+    // the pool worker that runs this thread context, or nullptr if the job has threads of its own.
+    PoolWorker *worker;
+    // spill mode only: the sorted runs this thread wrote, and the number of pairs in them.
+    std::vector<FILE *> *spillRuns;
+    uint32_t spilledPairs;
+    // true while this thread writes a run, so the combiner's emit2 does not spill again.
+    bool spilling;
+    // true while the combiner runs, so its emit2 is counted in pairsCombined, not pairsEmitted.
+    bool combining;
 };
 
 /**
@@ -38,10 +191,15 @@ struct ThreadContext {
  */
 struct JobContext {
     int MT_LEVEL;
-    stage_t stage = UNDEFINED_STAGE;
-    int *numPairs;
+    JobConfig config;
+    // read by getJobState while the threads change it, see advance_stage.
+    std::atomic<stage_t> stage;
+    // the statistics of every thread.
+    ThreadCounters *stats;
+    std::atomic<uint32_t> *numPairs;
     const MapReduceClient *client;
-    std::atomic<uint32_t> *atomicIndexMap;
+    // the input range of every thread, see MapRange.
+    MapRange *mapRanges;
     std::atomic<uint32_t> *atomicFinishMap;
     std::atomic<uint32_t> *atomicShuffle;
     std::atomic<uint32_t> *atomicReduce;
@@ -49,38 +207,185 @@ struct JobContext {
     ThreadContext *tContexts;
     const InputVec *inputVec;
     OutputVec *outputVec;
-    std::deque<IntermediateVec *> *afterShuffleVec;
+    // signaled (with mutexReduce) when reduce work is added to spillGroups or
+    // readyPartitions, or when no more work will be added.
+    pthread_cond_t *reduceCv;
+    // spill mode only: merged groups (with their rank) waiting for reduce, protected by
+    // mutexReduce.
+    std::deque<std::pair<size_t, IntermediateVec *> > *spillGroups;
+    bool spillDone;
+    // PIPELINED_SHUFFLE only: the number of threads that did not flush their partitions yet.
+    // Any thread may add pairs to any partition until it flushed, so the last flush makes all
+    // the partitions ready at once, and they are added to readyPartitions (protected by
+    // mutexReduce, like partitionsTaken).
+    std::atomic<int> pendingFlushes;
+    std::deque<int> *readyPartitions;
+    int partitionsTaken;
+    // the groups of MERGE_SHUFFLE, all of them stored one after the other in the arena.
+    std::deque<GroupSpan> *afterShuffleVec;
+    IntermediateVec *arena;
     pthread_mutex_t *mutexReduce;
-    pthread_mutex_t *mutexOutputVec;
     pthread_mutex_t *mutexJoin;
     bool flagJoin;
     Barrier *barrier;
+    // the pool that runs the job, or nullptr if the job has threads of its own.
+    JobPool *pool;
+    // the stream this job belongs to, or nullptr if it is not a stream job.
+    StreamJob *stream;
+    // pool jobs only (under the pool mutex): the thread contexts of the job that did not finish
+    // yet, and finished is set by the last of them.
+    int slotsRunning;
+    bool finished;
+};
 
+/**
+ * a set of worker threads that runs the jobs submitted to it. Every job gets its own thread
+ * contexts and barrier when it starts, for the workers that were idle at that moment, and the
+ * thread contexts use the buffers of their workers.
+ */
+struct JobPool {
+    int MT_LEVEL;
+    pthread_t *threads;
+    PoolWorker *workers;
+    pthread_mutex_t mutex;
+    // idle workers wait here for a thread context to run (or for the pool to close).
+    pthread_cond_t workCv;
+    // waitForJob and closeJobPool wait here for jobs to finish.
+    pthread_cond_t doneCv;
+    // the jobs waiting for workers, in the order of submission.
+    std::deque<JobContext *> pending;
+    // the highest priority in pending (INT_MIN if it is empty). The map loops read it without
+    // the mutex to know if they should preempt their job.
+    std::atomic<int> topPending;
+    // the number of idle workers.
+    int idle;
+    // the number of jobs that did not finish (running or pending), and the sum of their weights.
+    int unfinished;
+    uint64_t weights;
+    // every worker is pinned to a cpu (see pin_thread).
+    bool pinThreads;
+    bool closing;
+};
+
+/**
+ * a thread of a JobPool. It runs one thread context of a job at a time, and may run a thread
+ * context of a job of a higher priority inside it (see preempt_map).
+ */
+struct PoolWorker {
+    JobPool *pool;
+    // the thread context this worker was given to run (under the pool mutex).
+    ThreadContext *slot;
+    bool idle;
+    // the buffers of the thread contexts this worker runs, one per nesting level (see
+    // preempt_map). They are allocated by the first job that needs them and kept for the next
+    // jobs, see bind_worker.
+    std::vector<ThreadContext> *buffers;
+    // the number of thread contexts this worker runs right now (under the pool mutex).
+    int running;
+};
+
+/**
+ * a job over pushed input (see StreamJob.h). Its threads map the input as it arrives and
+ * reduce a window when it is flushed.
+ */
+struct StreamJob {
+    JobContext *jc;
+    // a stream job has no input vector, so the map ranges of its threads are empty.
+    InputVec noInput;
+    pthread_mutex_t mutex;
+    // the threads wait here for input or for a flush.
+    pthread_cond_t workCv;
+    // flushStreamJob waits here for the input to be mapped and for the flush to end.
+    pthread_cond_t doneCv;
+    // the pushed input that no thread took yet.
+    std::deque<InputPair> queue;
+    // the number of threads that are mapping a chunk.
+    int mapping;
+    // incremented by every flush, so a thread knows it has not run it yet.
+    unsigned long flushes;
+    // the number of threads that did not finish the current flush.
+    int flushing;
+    size_t windowSize;
+    // the number of input pairs pushed since the last flush, the total of the map stage of the
+    // window (read by getJobState).
+    std::atomic<size_t> windowPairs;
+    bool closing;
 };
 
 void map_phase(ThreadContext *tc);
+bool claim_chunk(MapRange *mapRange, uint32_t *begin, uint32_t *end);
+bool steal_chunk(ThreadContext *tc, uint32_t *begin, uint32_t *end);
 void shuffle_phase(ThreadContext *tc);
+void partition_phase(ThreadContext *tc);
+void combine_phase(ThreadContext *tc);
+void write_run(ThreadContext *tc);
+bool spill_phase(ThreadContext *tc);
+void external_shuffle_phase(ThreadContext *tc);
+void spill_reduce_phase(ThreadContext *tc);
+void reduce_spilled_group(ThreadContext *tc, size_t rank, IntermediateVec *group);
+void hash_shuffle_phase(ThreadContext *tc);
+void sample_phase(ThreadContext *tc);
+void sample_shuffle_phase(ThreadContext *tc);
+int num_partitions(JobContext *jc);
+void flush_phase(ThreadContext *tc);
+void pipeline_reduce_phase(ThreadContext *tc);
+void reduce_partition(ThreadContext *tc, int partition);
+void release_part(JobContext *jc, IntermediateVec &part);
 void *reduce_phase(ThreadContext *tc);
-bool IsAllEmpty (ThreadContext *tContexts, int len);
-bool cmp (IntermediatePair firstPair, IntermediatePair secondPair);
+void output_phase(ThreadContext *tc);
+bool cmp (const IntermediatePair &firstPair, const IntermediatePair &secondPair);
+void sort_pairs(ThreadContext *tc, IntermediateVec *pairs);
+void radix_sort(std::vector<PrefixEntry> *entries, std::vector<PrefixEntry> *tmp);
 void *entryPoint (void *arg);
 void lockThread(pthread_mutex_t* mutex);
+void lockTimed(ThreadContext *tc, pthread_mutex_t *mutex);
+void waitCondTimed(ThreadContext *tc, pthread_cond_t *cv, pthread_mutex_t *mutex);
+void wait_barrier(ThreadContext *tc);
+bool advance_stage(JobContext *jc, stage_t from, stage_t to);
+uint64_t now_ns();
+float percentage (unsigned int done, unsigned int total);
+uint64_t add_time(std::atomic<uint64_t> &stat, uint64_t since);
+void add_stat(std::atomic<uint64_t> &stat, uint64_t value);
+void update_bytes(ThreadContext *tc, bool withBuckets);
 void unlockThread(pthread_mutex_t* mutex);
+void waitCond(pthread_cond_t *cv, pthread_mutex_t *mutex);
+void broadcastCond(pthread_cond_t *cv);
+void initThreadContexts(ThreadContext *tContexts, int len, JobContext *jc);
+void initJobThreads(JobContext *jc, int multiThreadLevel);
+void alloc_buffers(ThreadContext *tc, int buckets);
+void free_buffers(ThreadContext *tc);
+void bind_worker(ThreadContext *tc, PoolWorker *worker);
+void unbind_worker(ThreadContext *tc);
+void copy_buffers(ThreadContext *to, const ThreadContext *from);
+void preempt_map(ThreadContext *tc);
+int job_share(JobPool *pool, JobContext *jc);
+void start_job(JobPool *pool, JobContext *jc, PoolWorker *self);
+JobContext *pop_pending(JobPool *pool);
+void schedule_jobs(JobPool *pool);
+void finish_slot(JobPool *pool, ThreadContext *tc);
+void *streamEntryPoint (void *arg);
+void stream_flush_phase(ThreadContext *tc);
+void fold_state(ThreadContext *tc, IntermediateVec *window);
+const std::vector<int> &cpu_order();
+std::vector<int> read_cpu_order();
+void pin_thread(int index);
+void freeThreadContexts(ThreadContext *tContexts, int len);
+JobContext *createJobContext (const MapReduceClient &client, const InputVec &inputVec,
+                              OutputVec &outputVec, const JobConfig &config);
 
 /**
- * this function checks if all the intermediate vectors are empty.
- * @param tContexts array which contains pointers to all the vectors to check.
- * @param len num of intermediate vectors.
- * @return true- if all vectors empty, false- otherwise.
+ * orders the intermediate vectors of the threads by the key at their back (the greatest key
+ * they still hold), so a priority_queue of them gives the vector with the greatest key on top.
  */
-bool IsAllEmpty (ThreadContext *tContexts, int len)
-{
-  for (int i = 0; i < len; ++i)
+struct BackKeyCmp {
+    ThreadContext *tContexts;
+
+    bool operator() (int first, int second) const
     {
-      if (!tContexts[i].intermediateVec->empty ()) return false;
+      return *tContexts[first].intermediateVec->back ().first
+             < *tContexts[second].intermediateVec->back ().first;
     }
-  return true;
-}
+};
 
 /**
  * compare function.
@@ -88,11 +393,93 @@ bool IsAllEmpty (ThreadContext *tContexts, int len)
  * @param secondPair the second element to compare- pair with key, value
  * @return true if second greater than first, false- otherwise.
  */
-bool cmp (IntermediatePair firstPair, IntermediatePair secondPair)
+bool cmp (const IntermediatePair &firstPair, const IntermediatePair &secondPair)
 {
   return *firstPair.first < *secondPair.first;
 }
 
+/**
+ * sorts pairs by their keys. With JobConfig::prefixSort, the prefixes of the keys are radix
+ * sorted and K2::operator< only orders the pairs whose prefixes are equal.
+ * @param tc the thread that sorts (its buffers are used).
+ * @param pairs the pairs to sort.
+ */
+void sort_pairs(ThreadContext *tc, IntermediateVec *pairs)
+{
+  if (!tc->jobC->config.prefixSort || pairs->size () < RADIX_SORT_MIN_PAIRS)
+    {
+      std::sort (pairs->begin (), pairs->end (), cmp);
+      return;
+    }
+  const ClientHooks *hooks = tc->jobC->config.hooks;
+  std::vector<PrefixEntry> *entries = tc->prefixes;
+  entries->resize (pairs->size ());
+  for (size_t i = 0; i < pairs->size (); ++i)
+    {
+      (*entries)[i].prefix = hooks->sortPrefix ((*pairs)[i].first);
+      (*entries)[i].index = i;
+    }
+  radix_sort(entries, tc->prefixesTmp);
+
+  IntermediateVec *sorted = tc->sortedPairs;
+  sorted->clear ();
+  for (const PrefixEntry &entry : *entries)
+    {
+      sorted->push_back ((*pairs)[entry.index]);
+    }
+  // only the pairs with equal prefixes may still be out of order. A run of equal keys (the
+  // common case) is already sorted, and is_sorted finds it with one comparison per pair.
+  size_t start = 0;
+  while (start < entries->size ())
+    {
+      size_t end = start + 1;
+      while (end < entries->size () && (*entries)[end].prefix == (*entries)[start].prefix)
+        {
+          end++;
+        }
+      if (end - start > 1 && !std::is_sorted (sorted->begin () + start, sorted->begin () + end, cmp))
+        {
+          std::sort (sorted->begin () + start, sorted->begin () + end, cmp);
+        }
+      start = end;
+    }
+  pairs->swap (*sorted);
+}
+
+/**
+ * stable LSD radix sort of entries by their prefix, RADIX_BITS at a time. A digit in which all
+ * the prefixes are equal is skipped.
+ * @param tmp a buffer of the same size, its content is lost.
+ */
+void radix_sort(std::vector<PrefixEntry> *entries, std::vector<PrefixEntry> *tmp)
+{
+  tmp->resize (entries->size ());
+  for (int shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+      size_t counts[RADIX_BUCKETS] = {0};
+      for (const PrefixEntry &entry : *entries)
+        {
+          counts[(entry.prefix >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+      if (counts[((*entries)[0].prefix >> shift) & (RADIX_BUCKETS - 1)] == entries->size ())
+        {
+          continue;
+        }
+      size_t offset = 0;
+      for (size_t &count : counts)
+        {
+          size_t next = offset + count;
+          count = offset;
+          offset = next;
+        }
+      for (const PrefixEntry &entry : *entries)
+        {
+          (*tmp)[counts[(entry.prefix >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+        }
+      entries->swap (*tmp);
+    }
+}
+
 /**
  * This function produces a (K2*, V2*) pair.
  * @param key pointer to K2 object.
@@ -103,7 +490,27 @@ void emit2 (K2 *key, V2 *value, void *context)
 {
   ThreadContext *tc = (ThreadContext *) context;
   tc->intermediateVec->push_back (IntermediatePair (key, value));
-
+  if (tc->combining)
+    {
+      add_stat(tc->jobC->stats[tc->id].pairsCombined, 1);
+    }
+  else
+    {
+      add_stat(tc->jobC->stats[tc->id].pairsEmitted, 1);
+    }
+  size_t spillThreshold = tc->jobC->config.spillThreshold;
+  if (spillThreshold != 0 && !tc->spilling && tc->intermediateVec->size () >= spillThreshold)
+    {
+      // the run is sorted (and combined) just like the whole vector is after the map phase.
+      tc->spilling = true;
+      sort_pairs(tc, tc->intermediateVec);
+      if (tc->jobC->config.combine)
+        {
+          combine_phase(tc);
+        }
+      write_run(tc);
+      tc->spilling = false;
+    }
 }
 
 /**
@@ -115,9 +522,7 @@ void emit2 (K2 *key, V2 *value, void *context)
 void emit3 (K3 *key, V3 *value, void *context)
 {
   ThreadContext *tc = (ThreadContext *) context;
-  lockThread(tc->jobC->mutexOutputVec);
-  tc->jobC->outputVec->push_back (OutputPair (key, value));
-  unlockThread(tc->jobC->mutexOutputVec);
+  tc->outputVec->push_back (OutputPair (key, value));
 }
 
 /**
@@ -129,24 +534,166 @@ void emit3 (K3 *key, V3 *value, void *context)
 void *entryPoint (void *arg)
 {
   ThreadContext *tc = (ThreadContext *) arg;
+  if (tc->jobC->config.pinThreads && tc->worker == nullptr)
+    {
+      // before anything is allocated, so the buffers of the thread are on its node.
+      pin_thread(tc->id);
+    }
+
+  // the buffers may belong to a pool worker (see bind_worker), so drop what its previous job
+  // left behind (clear() keeps the memory for this job).
+  tc->intermediateVec->clear ();
+  tc->outputVec->clear ();
+  tc->outputRuns->clear ();
+  tc->spillRuns->clear ();
+  tc->spilledPairs = 0;
+  tc->ownGroups->clear ();
+  tc->samples->clear ();
+  tc->keyRange->clear ();
+
+  ThreadCounters *stats = tc->jobC->stats + tc->id;
+  uint64_t time = now_ns();
 
   // MAP PHASE - [ [null, "zzabbaazzz"], [null, "world"] ... ]
   map_phase(tc);
+  time = add_time(stats->mapNs, time);
+
+  shuffle_t shuffle = tc->jobC->config.shuffle;
+  bool partitioned = shuffle == HASH_SHUFFLE || shuffle == PIPELINED_SHUFFLE;
+  if (!partitioned || tc->jobC->config.combine)
+    {
+      // SORT PHASE - Each one (for example: string) has IntermediateVec [[a, 3], [b, 2], [z, 5] ...]
+      sort_pairs(tc, tc->intermediateVec);
+    }
+
+  // COMBINE PHASE - [[a, 3], [a, 5], [b, 2]] -> [[a, 8], [b, 2]] (keeps the vector sorted)
+  if (tc->jobC->config.combine)
+    {
+      combine_phase(tc);
+    }
 
-  // SORT PHASE - Each one (for example: string) has IntermediateVec [[a, 3], [b, 2], [z, 5] ...]
-  std::sort (tc->intermediateVec->begin (), tc->intermediateVec->end (), cmp);
+  if (partitioned)
+    {
+      // PARTITION PHASE - the pairs are spread into buckets, sorting is done per bucket later.
+      partition_phase(tc);
+    }
+  else if (shuffle == SAMPLE_SHUFFLE)
+    {
+      // SAMPLE PHASE - evenly spaced keys of the sorted vector are offered as splitters.
+      sample_phase(tc);
+    }
+  update_bytes(tc, true);
+  time = add_time(stats->sortNs, time);
+
+  if (shuffle == PIPELINED_SHUFFLE)
+    {
+      // no barriers: the partitions are reduced as soon as all the threads flushed them.
+      // (reduce_partition counts the time it sorts a partition as shuffle time)
+      flush_phase(tc);
+      pipeline_reduce_phase(tc);
+      output_phase(tc);
+      update_bytes(tc, false);
+      add_time(stats->reduceNs, time);
+      return nullptr;
+    }
 
   //barrier until all threads finish to sort
-  tc->jobC->barrier->barrier();
+  wait_barrier(tc);
+  time = now_ns();
+
+  // SPILL MODE - if any thread wrote runs to the disk, shuffle and reduce stream over the runs.
+  if (spill_phase(tc))
+    {
+      external_shuffle_phase(tc);
+      time = add_time(stats->shuffleNs, time);
+      spill_reduce_phase(tc);
+      output_phase(tc);
+      update_bytes(tc, false);
+      add_time(stats->reduceNs, time);
+      return nullptr;
+    }
 
   // SHUFFLE PHASE
-  shuffle_phase(tc);
+  if (shuffle == HASH_SHUFFLE)
+    {
+      hash_shuffle_phase(tc);
+    }
+  else if (shuffle == SAMPLE_SHUFFLE)
+    {
+      sample_shuffle_phase(tc);
+    }
+  else
+    {
+      shuffle_phase(tc);
+    }
+  time = add_time(stats->shuffleNs, time);
 
-  // barrier until the thread 0 will finish shuffling
-  tc->jobC->barrier->barrier();
+  // barrier until all the threads will finish shuffling
+  wait_barrier(tc);
+  time = now_ns();
+  if (shuffle == SAMPLE_SHUFFLE)
+    {
+      // no thread reads the sorted vectors of the others anymore, so the key range replaces ours.
+      tc->intermediateVec->swap (*tc->keyRange);
+    }
 
   // REDUCE PHASE [ [[a, 3], [a, 5] ...], [[b, 5], [b, 1] ...], ... ]
-  return reduce_phase(tc);
+  reduce_phase(tc);
+
+  // OUTPUT PHASE - the output buffers of the threads are copied into outputVec
+  output_phase(tc);
+  update_bytes(tc, false);
+  add_time(stats->reduceNs, time);
+  return nullptr;
+}
+
+/**
+ * copies the output buffers of all the threads into outputVec. thread 0 decides where every
+ * run goes, then every thread copies its own runs in parallel.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void output_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  if (!jc->config.orderedOutput || jc->config.shuffle == SAMPLE_SHUFFLE)
+    {
+      // one run of everything this thread emitted, in the order of the thread ids.
+      // (with SAMPLE_SHUFFLE, thread i reduced key range i in order, so this is ordered too)
+      OutputRun run = {(size_t) tc->id, 0, tc->outputVec->size (), 0};
+      tc->outputRuns->push_back (run);
+    }
+
+  // barrier until all the threads finish to reduce
+  wait_barrier(tc);
+  if (tc->id == 0)
+    {
+      std::vector<OutputRun *> runs;
+      for (int i = 0; i < jc->MT_LEVEL; ++i)
+        {
+          for (OutputRun &run : *jc->tContexts[i].outputRuns)
+            {
+              runs.push_back (&run);
+            }
+        }
+      std::sort (runs.begin (), runs.end (), [] (const OutputRun *first, const OutputRun *second)
+      { return first->rank < second->rank; });
+      size_t dest = jc->outputVec->size ();
+      for (OutputRun *run : runs)
+        {
+          run->dest = dest;
+          dest += run->end - run->begin;
+        }
+      jc->outputVec->resize (dest);
+    }
+  // barrier until thread 0 gives every run its place
+  wait_barrier(tc);
+
+  for (const OutputRun &run : *tc->outputRuns)
+    {
+      std::copy (tc->outputVec->begin () + run.begin, tc->outputVec->begin () + run.end,
+                 jc->outputVec->begin () + run.dest);
+    }
 }
 
 /**
@@ -159,29 +706,44 @@ void *entryPoint (void *arg)
 void *reduce_phase(ThreadContext *tc) {
     while (true)
       {
-        // only one thread can will in to change stage.
-        if ((tc->jobC->stage) == SHUFFLE_STAGE)
-        {
-            (tc->jobC->stage) = REDUCE_STAGE;
-            *(tc->jobC->atomicIndexMap) = 0;
-        }
+        // only one thread changes the stage.
+        advance_stage(tc->jobC, SHUFFLE_STAGE, REDUCE_STAGE);
+        if (tc->jobC->config.shuffle == HASH_SHUFFLE || tc->jobC->config.shuffle == SAMPLE_SHUFFLE)
+          {
+            // the groups of this thread are not shared, so no mutex is needed.
+            // they are reduced in the order of their keys.
+            for (const GroupSpan &group : *tc->ownGroups)
+              {
+                tc->reduceVec->assign (tc->intermediateVec->begin () + group.begin,
+                                       tc->intermediateVec->begin () + group.end);
+                tc->jobC->client->reduce (tc->reduceVec, tc);
+                *(tc->jobC->atomicReduce) += (uint32_t) (group.end - group.begin);
+              }
+            tc->ownGroups->clear ();
+            return nullptr;
+          }
         // we lock with mutex to protect back() / pop_back() functions.
-        lockThread(tc->jobC->mutexReduce);
+        lockTimed(tc, tc->jobC->mutexReduce);
         if (tc->jobC->afterShuffleVec->empty ())
           {
             unlockThread(tc->jobC->mutexReduce);
             return nullptr;
           }
-        IntermediateVec * VecToReduce = tc->jobC->afterShuffleVec->back ();
-        int numPairsToReduce = (int) VecToReduce->size ();
+        GroupSpan group = tc->jobC->afterShuffleVec->back ();
+        // the groups are sorted from the front, so this is the place of the group's key.
+        size_t rank = tc->jobC->afterShuffleVec->size () - 1;
         tc->jobC->afterShuffleVec->pop_back();
         unlockThread(tc->jobC->mutexReduce);
-        tc->jobC->client->reduce (VecToReduce, tc);
-        *(tc->jobC->atomicReduce) += numPairsToReduce;
-        // the pop_back() calls the destructor of the elements he has.
-        // afterShuffleVec has pointers to IntermediateVec, the destructor of a pointer does nothing!
-        // This is why we must delete the IntermediateVec by ourselves.
-        delete VecToReduce;
+        tc->reduceVec->assign (tc->jobC->arena->begin () + group.begin,
+                               tc->jobC->arena->begin () + group.end);
+        size_t outputBegin = tc->outputVec->size ();
+        tc->jobC->client->reduce (tc->reduceVec, tc);
+        if (tc->jobC->config.orderedOutput)
+          {
+            OutputRun run = {rank, outputBegin, tc->outputVec->size (), 0};
+            tc->outputRuns->push_back (run);
+          }
+        *(tc->jobC->atomicReduce) += (uint32_t) (group.end - group.begin);
       }
 }
 
@@ -196,167 +758,1759 @@ void shuffle_phase(ThreadContext *tc)
     // waits for thread 0 to be the running thread (ONLY thread 0 a.k.a. main-thread gets in)
     if (tc->id == 0)
       {
-        (tc->jobC->stage) = SHUFFLE_STAGE;
         int totalNumPairs = 0;
         int t_num = tc->jobC->MT_LEVEL;
         for (int i = 0; i < t_num; i++)
           {
             totalNumPairs += (int) tc->jobC->tContexts[i].intermediateVec->size ();
           }
-          *tc->jobC->numPairs = totalNumPairs;
-        while (!IsAllEmpty (tc->jobC->tContexts, t_num))
+        // numPairs is set before the stage, so getJobState never divides by a partial count.
+        *tc->jobC->numPairs = totalNumPairs;
+        (tc->jobC->stage) = SHUFFLE_STAGE;
+        IntermediateVec *arena = tc->jobC->arena;
+        arena->reserve (totalNumPairs);
+        // k-way merge: a heap of the non empty vectors, ordered by their greatest key.
+        // every pair costs O(log MT_LEVEL) instead of a scan over all the vectors for every key.
+        BackKeyCmp backKeyCmp = {tc->jobC->tContexts};
+        std::priority_queue<int, std::vector<int>, BackKeyCmp> heap (backKeyCmp);
+        for (int i = 0; i < t_num; ++i)
           {
-            K2 *max_key = nullptr;
-            for (int i = 0; i < t_num; ++i)
+            if (!tc->jobC->tContexts[i].intermediateVec->empty ())
               {
-                if (!tc->jobC->tContexts[i].intermediateVec->empty ())
-                  {
-                    K2 *currentKey = tc->jobC->tContexts[i].intermediateVec->back ().first;
-                    if (max_key == nullptr)
-                      {
-                        max_key = currentKey;
-                      }
-                    else
-                      {
-                        if (*max_key < *currentKey)
-                          {
-                            max_key = currentKey;
-                          }
-                      }
-                  }
+                heap.push (i);
               }
-            IntermediateVec *NewVecKey = new IntermediateVec;
-            for (int i = 0; i < t_num; ++i)
+          }
+        while (!heap.empty ())
+          {
+            K2 *max_key = tc->jobC->tContexts[heap.top ()].intermediateVec->back ().first;
+            GroupSpan group = {arena->size (), 0};
+            // all the vectors whose greatest key equals max_key are on top of the heap.
+            while (!heap.empty ()
+                   && !(*(tc->jobC->tContexts[heap.top ()].intermediateVec->back ().first) < *max_key))
               {
+                int i = heap.top ();
+                heap.pop ();
                 IntermediateVec *currentVec = tc->jobC->tContexts[i].intermediateVec;
-                while (!currentVec->empty ()
-                && !(*max_key < *(currentVec->back().first)) && !(*(currentVec->back().first) < *max_key))
+                while (!currentVec->empty () && !(*(currentVec->back().first) < *max_key))
                   {
-                    NewVecKey->push_back (currentVec->back ());
+                    arena->push_back (currentVec->back ());
                     currentVec->pop_back ();
                   }
+                if (!currentVec->empty ())
+                  {
+                    heap.push (i);
+                  }
               }
-            tc->jobC->afterShuffleVec->push_front(NewVecKey);
-            *(tc->jobC->atomicShuffle) += (NewVecKey->size ());
+            group.end = arena->size ();
+            tc->jobC->afterShuffleVec->push_front(group);
+            *(tc->jobC->atomicShuffle) += (uint32_t) (group.end - group.begin);
           }
       }
 }
 
 /**
- * In this phase each thread reads pairs of (k1,  v1) from the input vector and calls the map function
- * on each of them.
+ * calls the combiner of the client on every sequence of identical keys in the sorted
+ * intermediateVec of this thread. The pairs emitted by the combiner replace the original ones.
  * @param tc struct which includes all the parameters which are relevant to the thread.
  * Each thread has its own thread context.
  */
-void map_phase(ThreadContext *tc) {//change the state of the counter to map phase
-    if ((tc->jobC->stage) == UNDEFINED_STAGE)
-      {
-        (tc->jobC->stage) = MAP_STAGE;
-      }
-
-    // store the current index to map in old val and increment by 1 the counter
-    int oldValue = (int) (*(tc->jobC->atomicIndexMap))++;
-    int inputVecSize = (int) tc->jobC->inputVec->size ();
-
-    // until we finish mapping all the pairs in inputVec
-    while (inputVecSize > oldValue)
-      {
-        const K1 *key = tc->jobC->inputVec->at (oldValue).first;
-        const V1 *value = tc->jobC->inputVec->at (oldValue).second;
-        // inside map emit2 is called. the pairs(k2, v2) are put inside the
-        // intermediateVec that each thread context has.
-        tc->jobC->client->map (key, value, tc);
-          (*(tc->jobC->atomicFinishMap)) ++; // after map() is done, we increase the num of finished pairs.
-          oldValue = (int) (*(tc->jobC->atomicIndexMap))++;
-      }
+void combine_phase(ThreadContext *tc)
+{
+  const ClientHooks *hooks = tc->jobC->config.hooks;
+  IntermediateVec *sorted = tc->intermediateVec;
+  // emit2 of the combiner writes into the new intermediateVec.
+  tc->intermediateVec = new IntermediateVec;
+  tc->combining = true;
+  IntermediateVec group;
+  size_t start = 0;
+  while (start < sorted->size ())
+    {
+      K2 *key = (*sorted)[start].first;
+      size_t end = start + 1;
+      while (end < sorted->size () && !(*key < *(*sorted)[end].first))
+        {
+          end++;
+        }
+      group.assign (sorted->begin () + start, sorted->begin () + end);
+      hooks->combine (&group, tc);
+      start = end;
+    }
+  tc->combining = false;
+  delete sorted;
 }
 
 /**
- * This function starts running the MapReduce algorithm (with several threads)
- * @param client The implementation of MapReduceClient or in other words the task that the framework should run.
- * @param inputVec a vector of type std::vector<std::pair<K1*, V1*>>, the input elements.
- * @param outputVec a vector of type std::vector<std::pair<K3*, V3*>>, to which the output
- * elements will be added before returning
- * @param multiThreadLevel the number of worker threads to be used for running the algorithm.
- * @return an identifier of a running job.
+ * writes the sorted intermediateVec of this thread to a new run file, and deletes the pairs
+ * from the memory.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
  */
-JobHandle startMapReduceJob (const MapReduceClient &client,
-                             const InputVec &inputVec, OutputVec &outputVec,
-                             int multiThreadLevel)
+void write_run(ThreadContext *tc)
 {
-  JobContext *jc = new JobContext;
-  pthread_mutex_t *mutexReduce = new pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER);
-  pthread_mutex_t *mutexOutputVec = new pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER);
-  pthread_mutex_t *mutexJoin = new pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER);
-  jc->mutexReduce = mutexReduce;
-  jc->mutexOutputVec = mutexOutputVec;
-  jc->mutexJoin = mutexJoin;
-  jc->threads = new pthread_t[multiThreadLevel];
-  jc->tContexts = new ThreadContext[multiThreadLevel];
-  jc->afterShuffleVec = new std::deque<IntermediateVec *>;
-  jc->MT_LEVEL = multiThreadLevel;
-  jc->client = &client;
-  jc->inputVec = &inputVec;
-  jc->outputVec = &outputVec;
-  jc->atomicIndexMap = new std::atomic<uint32_t> (0);
-  jc->atomicFinishMap = new std::atomic<uint32_t> (0);
-  jc->atomicShuffle = new std::atomic<uint32_t> (0);
-  jc->atomicReduce= new std::atomic<uint32_t> (0);
-  jc->flagJoin = false;
-  jc->barrier = new Barrier(multiThreadLevel);
-  jc->numPairs = new int(0);
-  for (int i = 0; i < multiThreadLevel; ++i)
+  const ClientHooks *hooks = tc->jobC->config.hooks;
+  // tmpfile() is removed by the system when it is closed.
+  FILE *file = tmpfile ();
+  if (file == nullptr)
     {
-      jc->tContexts[i].id = i;
-      jc->tContexts[i].jobC = jc;
-      jc->tContexts[i].intermediateVec = new IntermediateVec;
+      std::cerr << SPILL_FILE_FAIL_MSG << std::endl;
+      exit (1);
     }
-  for (int i = 0; i < multiThreadLevel; i++)
+  for (const IntermediatePair &pair : *tc->intermediateVec)
     {
-      if (pthread_create (jc->threads + i, NULL, entryPoint, jc->tContexts + i)
-          != 0)
+      if (!hooks->writePair (pair.first, pair.second, file))
         {
-          std::cerr << PTHREAD_CREATE_FAIL_MSG << std::endl;
+          std::cerr << SPILL_WRITE_FAIL_MSG << std::endl;
           exit (1);
         }
+      delete pair.first;
+      delete pair.second;
     }
-  return (JobHandle) jc;
+  if (fflush (file) != 0)
+    {
+      std::cerr << SPILL_WRITE_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  rewind (file);
+  tc->spillRuns->push_back (file);
+  tc->spilledPairs += (uint32_t) tc->intermediateVec->size ();
+  tc->intermediateVec->clear ();
 }
 
 /**
- *  a function gets JobHandle returned by startMapReduceFramework and waits
- *  until it is finished.
- * @param job an identifier of a running job.
+ * decides if the job runs in spill mode: if any thread wrote a run, every thread writes
+ * what it still holds in memory as a last run, so the shuffle reads everything from the runs.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ * @return true if the job spilled (the same answer for all the threads).
  */
-void waitForJob (JobHandle job)
+bool spill_phase(ThreadContext *tc)
 {
+  JobContext *jc = tc->jobC;
+  if (jc->config.spillThreshold == 0)
+    {
+      return false;
+    }
+  // the runs do not change after the first barrier, so all the threads see the same thing.
+  bool spilled = false;
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      spilled = spilled || !jc->tContexts[i].spillRuns->empty ();
+    }
+  if (!spilled)
+    {
+      return false;
+    }
+  // barrier until all the threads checked the runs, before new runs are added.
+  wait_barrier(tc);
+  if (!tc->intermediateVec->empty ())
+    {
+      write_run(tc);
+    }
+  // barrier until all the threads wrote their last run
+  wait_barrier(tc);
+  return true;
+}
 
-  JobContext *jc = (JobContext *) job;
-
-  lockThread(jc->mutexJoin);
-    if (jc->flagJoin)
+/**
+ * spill mode: thread 0 merges the runs of all the threads from the disk (k-way merge over
+ * a heap of readers), and hands every group of identical keys to the reducers as soon as it
+ * is complete. Only the groups waiting for reduce are kept in the memory.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void external_shuffle_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  if (tc->id != 0)
     {
-      unlockThread(jc->mutexJoin);
       return;
     }
-  jc->flagJoin = true;
-  unlockThread(jc->mutexJoin);
-
+  const ClientHooks *hooks = jc->config.hooks;
+  uint32_t totalNumPairs = 0;
+  std::priority_queue<SpillReader, std::vector<SpillReader>, ReaderKeyCmp> heap;
   for (int i = 0; i < jc->MT_LEVEL; ++i)
     {
-      if (pthread_join (jc->threads[i], nullptr) != 0)
+      totalNumPairs += jc->tContexts[i].spilledPairs;
+      for (FILE *file : *jc->tContexts[i].spillRuns)
         {
-          std::cerr << PTHREAD_JOIN_FAIL_MSG << std::endl;
-          exit (1);
+          SpillReader reader = {file, IntermediatePair (nullptr, nullptr)};
+          if (hooks->readPair (file, &reader.current.first, &reader.current.second))
+            {
+              heap.push (reader);
+            }
+          else
+            {
+              fclose (file);
+            }
         }
+      jc->tContexts[i].spillRuns->clear ();
     }
+  *jc->numPairs = totalNumPairs;
+  (jc->stage) = SHUFFLE_STAGE;
 
-  delete[] jc->threads;
-  jc->threads = nullptr;
+  size_t rank = 0;
+  while (!heap.empty ())
+    {
+      IntermediateVec *group = new IntermediateVec;
+      K2 *key = heap.top ().current.first;
+      // all the readers whose current key equals key are on top of the heap.
+      while (!heap.empty () && !(*key < *heap.top ().current.first))
+        {
+          SpillReader reader = heap.top ();
+          heap.pop ();
+          group->push_back (reader.current);
+          if (hooks->readPair (reader.file, &reader.current.first, &reader.current.second))
+            {
+              heap.push (reader);
+            }
+          else
+            {
+              fclose (reader.file);
+            }
+        }
+      *(jc->atomicShuffle) += (uint32_t) group->size ();
+
+      lockTimed(tc, jc->mutexReduce);
+      if (jc->spillGroups->size () >= SPILL_QUEUE_GROUPS)
+        {
+          // the reducers are behind: instead of waiting, reduce the oldest group ourselves.
+          std::pair<size_t, IntermediateVec *> oldest = jc->spillGroups->front ();
+          jc->spillGroups->pop_front ();
+          jc->spillGroups->push_back (std::make_pair (rank++, group));
+          unlockThread(jc->mutexReduce);
+          reduce_spilled_group(tc, oldest.first, oldest.second);
+          continue;
+        }
+      jc->spillGroups->push_back (std::make_pair (rank++, group));
+      broadcastCond(jc->reduceCv);
+      unlockThread(jc->mutexReduce);
+    }
 
+  lockTimed(tc, jc->mutexReduce);
+  (jc->stage) = REDUCE_STAGE;
+  jc->spillDone = true;
+  broadcastCond(jc->reduceCv);
+  unlockThread(jc->mutexReduce);
 }
 
-void lockThread(pthread_mutex_t* mutex) {
+/**
+ * spill mode: reduces the groups merged by thread 0 until the merge is done and no group is left.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void spill_reduce_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  lockTimed(tc, jc->mutexReduce);
+  while (true)
+    {
+      while (jc->spillGroups->empty () && !jc->spillDone)
+        {
+          waitCondTimed(tc, jc->reduceCv, jc->mutexReduce);
+        }
+      if (jc->spillGroups->empty ())
+        {
+          unlockThread(jc->mutexReduce);
+          return;
+        }
+      std::pair<size_t, IntermediateVec *> next = jc->spillGroups->front ();
+      jc->spillGroups->pop_front ();
+      unlockThread(jc->mutexReduce);
+      reduce_spilled_group(tc, next.first, next.second);
+      lockTimed(tc, jc->mutexReduce);
+    }
+}
+
+/**
+ * reduces one group read back from the runs, and deletes it.
+ * @param rank the place of the group's key among all the keys.
+ */
+void reduce_spilled_group(ThreadContext *tc, size_t rank, IntermediateVec *group)
+{
+  size_t outputBegin = tc->outputVec->size ();
+  tc->jobC->client->reduce (group, tc);
+  if (tc->jobC->config.orderedOutput)
+    {
+      OutputRun run = {rank, outputBegin, tc->outputVec->size (), 0};
+      tc->outputRuns->push_back (run);
+    }
+  *(tc->jobC->atomicReduce) += (uint32_t) group->size ();
+  delete group;
+}
+
+/**
+ * @return the number of partitions of the keys: MT_LEVEL for HASH_SHUFFLE, more for
+ * PIPELINED_SHUFFLE.
+ */
+int num_partitions(JobContext *jc)
+{
+  if (jc->config.shuffle == PIPELINED_SHUFFLE)
+    {
+      return jc->MT_LEVEL * PARTITIONS_PER_THREAD;
+    }
+  return jc->MT_LEVEL;
+}
+
+/**
+ * PIPELINED_SHUFFLE: tells that this thread will not add pairs to any partition anymore.
+ * The last thread to flush makes all the partitions ready for reduce. (the keys of a partition
+ * may come from any input pair, so no partition is complete before all the input is mapped,
+ * and reduce does not overlap the map phase; what the threads skip are the barriers, and the
+ * partitions balance the shuffle and reduce between them.)
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void flush_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  // the buckets of this thread are complete before the decrement, and the threads that
+  // reduce the partitions read them only after the last thread decremented it to 0.
+  if (--jc->pendingFlushes != 0)
+    {
+      return;
+    }
+  int partitions = num_partitions(jc);
+  lockTimed(tc, jc->mutexReduce);
+  for (int p = 0; p < partitions; ++p)
+    {
+      jc->readyPartitions->push_back (p);
+    }
+  advance_stage(jc, MAP_STAGE, SHUFFLE_STAGE);
+  broadcastCond(jc->reduceCv);
+  unlockThread(jc->mutexReduce);
+}
+
+/**
+ * PIPELINED_SHUFFLE: takes ready partitions and reduces them, until every partition was taken.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void pipeline_reduce_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  int partitions = num_partitions(jc);
+  lockTimed(tc, jc->mutexReduce);
+  while (jc->partitionsTaken < partitions)
+    {
+      if (jc->readyPartitions->empty ())
+        {
+          waitCondTimed(tc, jc->reduceCv, jc->mutexReduce);
+          continue;
+        }
+      int partition = jc->readyPartitions->front ();
+      jc->readyPartitions->pop_front ();
+      if (++jc->partitionsTaken == partitions)
+        {
+          // every partition is being grouped or reduced, what is left is reducing.
+          (jc->stage) = REDUCE_STAGE;
+        }
+      unlockThread(jc->mutexReduce);
+      reduce_partition(tc, partition);
+      lockTimed(tc, jc->mutexReduce);
+    }
+  unlockThread(jc->mutexReduce);
+}
+
+/**
+ * PIPELINED_SHUFFLE: collects a ready partition from the buckets of all the threads, sorts it,
+ * and reduces every sequence of identical keys in it.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ * @param partition the partition to reduce.
+ */
+void reduce_partition(ThreadContext *tc, int partition)
+{
+  JobContext *jc = tc->jobC;
+  uint64_t time = now_ns();
+  IntermediateVec *pairs = tc->intermediateVec;
+  pairs->clear ();
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      IntermediateVec &part = jc->tContexts[i].buckets[partition];
+      pairs->insert (pairs->end (), part.begin (), part.end ());
+      release_part(jc, part);
+    }
+  sort_pairs(tc, pairs);
+  *(jc->atomicShuffle) += (uint32_t) pairs->size ();
+  update_bytes(tc, false);
+  add_time(jc->stats[tc->id].shuffleNs, time);
+
+  size_t start = 0;
+  while (start < pairs->size ())
+    {
+      K2 *key = (*pairs)[start].first;
+      size_t end = start + 1;
+      while (end < pairs->size () && !(*key < *(*pairs)[end].first))
+        {
+          end++;
+        }
+      tc->reduceVec->assign (pairs->begin () + start, pairs->begin () + end);
+      jc->client->reduce (tc->reduceVec, tc);
+      *(jc->atomicReduce) += (uint32_t) (end - start);
+      start = end;
+    }
+  pairs->clear ();
+}
+
+/**
+ * empties a bucket whose pairs were collected by the thread that groups them. Its memory is
+ * released right away, unless the bucket belongs to a pool worker, which keeps it for its next
+ * jobs.
+ */
+void release_part(JobContext *jc, IntermediateVec &part)
+{
+  if (jc->pool != nullptr)
+    {
+      part.clear ();
+      return;
+    }
+  IntermediateVec ().swap (part);
+}
+
+/**
+ * HASH_SHUFFLE and PIPELINED_SHUFFLE: spreads the pairs this thread emitted into buckets by the
+ * hash of their key, so that all the pairs with the same key end up in the same bucket index.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void partition_phase(ThreadContext *tc)
+{
+  int partitions = num_partitions(tc->jobC);
+  const ClientHooks *hooks = tc->jobC->config.hooks;
+  for (const IntermediatePair &pair : *tc->intermediateVec)
+    {
+      tc->buckets[hooks->hashKey (pair.first) % partitions].push_back (pair);
+    }
+  *(tc->jobC->numPairs) += (uint32_t) tc->intermediateVec->size ();
+  tc->intermediateVec->clear ();
+}
+
+/**
+ * HASH_SHUFFLE: every thread collects its own bucket from all the threads, sorts it and
+ * cuts it into sequences of identical keys. All threads run this phase in parallel.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void hash_shuffle_phase(ThreadContext *tc)
+{
+  if (tc->id == 0)
+    {
+      (tc->jobC->stage) = SHUFFLE_STAGE;
+    }
+  int t_num = tc->jobC->MT_LEVEL;
+  IntermediateVec *bucket = tc->intermediateVec;
+  for (int i = 0; i < t_num; ++i)
+    {
+      IntermediateVec &part = tc->jobC->tContexts[i].buckets[tc->id];
+      bucket->insert (bucket->end (), part.begin (), part.end ());
+      release_part(tc->jobC, part);
+    }
+  sort_pairs(tc, bucket);
+
+  size_t start = 0;
+  while (start < bucket->size ())
+    {
+      K2 *key = (*bucket)[start].first;
+      size_t end = start + 1;
+      while (end < bucket->size () && !(*key < *(*bucket)[end].first))
+        {
+          end++;
+        }
+      GroupSpan group = {start, end};
+      tc->ownGroups->push_back (group);
+      *(tc->jobC->atomicShuffle) += (uint32_t) (end - start);
+      start = end;
+    }
+}
+
+/**
+ * SAMPLE_SHUFFLE: picks SAMPLES_PER_THREAD evenly spaced keys of the sorted intermediateVec of
+ * this thread, and counts its pairs in the total of the job.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void sample_phase(ThreadContext *tc)
+{
+  IntermediateVec *sorted = tc->intermediateVec;
+  if (!sorted->empty ())
+    {
+      for (size_t k = 0; k < SAMPLES_PER_THREAD; ++k)
+        {
+          // the middle of the k-th of SAMPLES_PER_THREAD equal parts of the vector.
+          size_t index = (k * 2 + 1) * sorted->size () / (SAMPLES_PER_THREAD * 2);
+          tc->samples->push_back ((*sorted)[index].first);
+        }
+    }
+  *(tc->jobC->numPairs) += (uint32_t) sorted->size ();
+}
+
+/**
+ * SAMPLE_SHUFFLE: every thread chooses the same MT_LEVEL - 1 splitters from the samples of all
+ * the threads (so no thread has to publish them and wait for another barrier), merges the
+ * pairs of its key range from the sorted vectors of all the threads and cuts them into
+ * sequences of identical keys. All threads run this phase in parallel.
+ * Thread i takes the keys k with splitter[i - 1] <= k < splitter[i].
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void sample_shuffle_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  advance_stage(jc, MAP_STAGE, SHUFFLE_STAGE);
+  int t_num = jc->MT_LEVEL;
+  std::vector<K2 *> samples;
+  for (int i = 0; i < t_num; ++i)
+    {
+      const std::vector<K2 *> *own = jc->tContexts[i].samples;
+      samples.insert (samples.end (), own->begin (), own->end ());
+    }
+  auto keyCmp = [] (const K2 *first, const K2 *second) { return *first < *second; };
+  std::sort (samples.begin (), samples.end (), keyCmp);
+  // the range of this thread is bounded by the samples at id / MT_LEVEL and (id + 1) / MT_LEVEL
+  // (a missing bound is the end of the keys).
+  size_t numSamples = samples.size ();
+  K2 *low = tc->id == 0 || numSamples == 0 ? nullptr : samples[numSamples * tc->id / t_num];
+  K2 *high = tc->id == t_num - 1 || numSamples == 0 ? nullptr : samples[numSamples * (tc->id + 1) / t_num];
+  auto pairCmp = [] (const IntermediatePair &pair, const K2 *key) { return *pair.first < *key; };
+
+  // the slice of every thread is sorted, so the slices are merged two at a time, each time
+  // with the one next to it (log MT_LEVEL rounds).
+  IntermediateVec *range = tc->keyRange;
+  std::vector<size_t> bounds (1, 0);
+  for (int i = 0; i < t_num; ++i)
+    {
+      const IntermediateVec *sorted = jc->tContexts[i].intermediateVec;
+      IntermediateVec::const_iterator begin = sorted->begin ();
+      IntermediateVec::const_iterator end = sorted->end ();
+      if (low != nullptr)
+        {
+          begin = std::lower_bound (begin, end, low, pairCmp);
+        }
+      if (high != nullptr)
+        {
+          end = std::lower_bound (begin, end, high, pairCmp);
+        }
+      range->insert (range->end (), begin, end);
+      bounds.push_back (range->size ());
+    }
+  for (size_t width = 1; width < (size_t) t_num; width *= 2)
+    {
+      for (size_t first = 0; first + width < (size_t) t_num; first += width * 2)
+        {
+          size_t last = std::min (first + width * 2, (size_t) t_num);
+          std::inplace_merge (range->begin () + bounds[first], range->begin () + bounds[first + width],
+                              range->begin () + bounds[last], cmp);
+        }
+    }
+
+  size_t start = 0;
+  while (start < range->size ())
+    {
+      K2 *key = (*range)[start].first;
+      size_t end = start + 1;
+      while (end < range->size () && !(*key < *(*range)[end].first))
+        {
+          end++;
+        }
+      GroupSpan group = {start, end};
+      tc->ownGroups->push_back (group);
+      *(jc->atomicShuffle) += (uint32_t) (end - start);
+      start = end;
+    }
+}
+
+/**
+ * In this phase each thread reads pairs of (k1,  v1) from the input vector and calls the map function
+ * on each of them.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void map_phase(ThreadContext *tc) {//change the state of the counter to map phase
+    advance_stage(tc->jobC, UNDEFINED_STAGE, MAP_STAGE);
+
+    const InputVec &inputVec = *tc->jobC->inputVec;
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    // until we finish mapping our range, and there is nothing left to steal from the others
+    while (claim_chunk(tc->jobC->mapRanges + tc->id, &begin, &end) || steal_chunk(tc, &begin, &end))
+      {
+        for (uint32_t i = begin; i < end; ++i)
+          {
+            // inside map emit2 is called. the pairs(k2, v2) are put inside the
+            // intermediateVec that each thread context has.
+            tc->jobC->client->map (inputVec[i].first, inputVec[i].second, tc);
+            if (tc->worker != nullptr
+                && tc->worker->pool->topPending.load (std::memory_order_relaxed) > tc->jobC->config.priority)
+              {
+                preempt_map(tc);
+              }
+          }
+        // after the chunk is mapped, we increase the num of finished pairs (once per chunk).
+        (*(tc->jobC->atomicFinishMap)) += end - begin;
+      }
+}
+
+/**
+ * the owner of a map range claims a chunk from its front. The chunk is a fixed part of what is
+ * left in the range, so it is large while there is a lot of work and shrinks towards the end.
+ * @param mapRange the range of the calling thread.
+ * @param begin, end the claimed chunk [begin, end).
+ * @return true if a chunk was claimed, false if the range is empty.
+ */
+bool claim_chunk(MapRange *mapRange, uint32_t *begin, uint32_t *end)
+{
+  uint64_t old = mapRange->range.load ();
+  while (true)
+    {
+      uint32_t oldBegin = (uint32_t) (old >> 32);
+      uint32_t oldEnd = (uint32_t) old;
+      if (oldBegin >= oldEnd)
+        {
+          return false;
+        }
+      uint32_t chunk = std::max ((oldEnd - oldBegin) / MAP_CHUNK_DIVISOR, (uint32_t) 1);
+      uint64_t claimed = ((uint64_t) (oldBegin + chunk) << 32) | oldEnd;
+      if (mapRange->range.compare_exchange_weak (old, claimed))
+        {
+          *begin = oldBegin;
+          *end = oldBegin + chunk;
+          return true;
+        }
+    }
+}
+
+/**
+ * a thread that finished its own range steals half of what is left in the range of another
+ * thread (from its back). The stolen part becomes the range of the thief, so others may steal
+ * from it in turn, and a chunk of it is claimed right away.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * @param begin, end the claimed chunk [begin, end).
+ * @return true if a chunk was claimed, false if all the ranges are empty.
+ */
+bool steal_chunk(ThreadContext *tc, uint32_t *begin, uint32_t *end)
+{
+  int t_num = tc->jobC->MT_LEVEL;
+  for (int i = 1; i < t_num; ++i)
+    {
+      MapRange *victim = tc->jobC->mapRanges + (tc->id + i) % t_num;
+      uint64_t old = victim->range.load ();
+      while (true)
+        {
+          uint32_t oldBegin = (uint32_t) (old >> 32);
+          uint32_t oldEnd = (uint32_t) old;
+          if (oldBegin >= oldEnd)
+            {
+              break;
+            }
+          uint32_t stolen = (oldEnd - oldBegin + 1) / 2;
+          uint64_t left = ((uint64_t) oldBegin << 32) | (oldEnd - stolen);
+          if (victim->range.compare_exchange_weak (old, left))
+            {
+              // our own range is empty, so no other thread changes it and a store is enough.
+              tc->jobC->mapRanges[tc->id].range.store (((uint64_t) (oldEnd - stolen) << 32) | oldEnd);
+              return claim_chunk(tc->jobC->mapRanges + tc->id, begin, end);
+            }
+        }
+    }
+  return false;
+}
+
+/**
+ * This function starts running the MapReduce algorithm (with several threads)
+ * @param client The implementation of MapReduceClient or in other words the task that the framework should run.
+ * @param inputVec a vector of type std::vector<std::pair<K1*, V1*>>, the input elements.
+ * @param outputVec a vector of type std::vector<std::pair<K3*, V3*>>, to which the output
+ * elements will be added before returning
+ * @param multiThreadLevel the number of worker threads to be used for running the algorithm.
+ * @return an identifier of a running job.
+ */
+JobHandle startMapReduceJob (const MapReduceClient &client,
+                             const InputVec &inputVec, OutputVec &outputVec,
+                             int multiThreadLevel)
+{
+  return startMapReduceJob (client, inputVec, outputVec, multiThreadLevel, JobConfig ());
+}
+
+/**
+ * This function starts running the MapReduce algorithm (with several threads)
+ * with the given configuration.
+ * @param config the shuffle to use and the client hooks it needs.
+ * @return an identifier of a running job.
+ */
+JobHandle startMapReduceJob (const MapReduceClient &client,
+                             const InputVec &inputVec, OutputVec &outputVec,
+                             int multiThreadLevel, const JobConfig &config)
+{
+  JobContext *jc = createJobContext (client, inputVec, outputVec, config);
+  initJobThreads (jc, multiThreadLevel);
+  jc->threads = new pthread_t[multiThreadLevel];
+  for (int i = 0; i < multiThreadLevel; i++)
+    {
+      if (pthread_create (jc->threads + i, NULL, entryPoint, jc->tContexts + i)
+          != 0)
+        {
+          std::cerr << PTHREAD_CREATE_FAIL_MSG << std::endl;
+          exit (1);
+        }
+    }
+  return (JobHandle) jc;
+}
+
+/**
+ * allocates the shared state of a new job, without its threads and the parts that depend on
+ * their number (see initJobThreads).
+ * @return the new job context.
+ */
+JobContext *createJobContext (const MapReduceClient &client, const InputVec &inputVec,
+                              OutputVec &outputVec, const JobConfig &config)
+{
+  if ((config.shuffle == HASH_SHUFFLE || config.shuffle == PIPELINED_SHUFFLE || config.combine
+       || config.spillThreshold != 0 || config.prefixSort) && config.hooks == nullptr)
+    {
+      std::cerr << NO_HOOKS_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  if (config.orderedOutput && config.shuffle != MERGE_SHUFFLE && config.shuffle != SAMPLE_SHUFFLE)
+    {
+      std::cerr << ORDERED_OUTPUT_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  if (config.spillThreshold != 0 && config.shuffle != MERGE_SHUFFLE)
+    {
+      std::cerr << SPILL_SHUFFLE_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  JobContext *jc = new JobContext;
+  jc->config = config;
+  pthread_mutex_t *mutexReduce = new pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER);
+  pthread_mutex_t *mutexJoin = new pthread_mutex_t (PTHREAD_MUTEX_INITIALIZER);
+  jc->mutexReduce = mutexReduce;
+  jc->mutexJoin = mutexJoin;
+  jc->threads = nullptr;
+  jc->tContexts = nullptr;
+  jc->barrier = nullptr;
+  jc->pool = nullptr;
+  jc->stream = nullptr;
+  jc->slotsRunning = 0;
+  jc->finished = false;
+  jc->afterShuffleVec = new std::deque<GroupSpan>;
+  jc->arena = new IntermediateVec;
+  jc->spillGroups = new std::deque<std::pair<size_t, IntermediateVec *> >;
+  jc->reduceCv = new pthread_cond_t (PTHREAD_COND_INITIALIZER);
+  jc->spillDone = false;
+  jc->readyPartitions = new std::deque<int>;
+  jc->partitionsTaken = 0;
+  jc->MT_LEVEL = 0;
+  jc->mapRanges = nullptr;
+  jc->stats = nullptr;
+  jc->client = &client;
+  jc->inputVec = &inputVec;
+  jc->outputVec = &outputVec;
+  jc->atomicFinishMap = new std::atomic<uint32_t> (0);
+  jc->atomicShuffle = new std::atomic<uint32_t> (0);
+  jc->atomicReduce= new std::atomic<uint32_t> (0);
+  jc->flagJoin = false;
+  jc->numPairs = new std::atomic<uint32_t> (0);
+  jc->stage = UNDEFINED_STAGE;
+  return jc;
+}
+
+/**
+ * allocates the parts of a job that depend on the number of its threads: the thread contexts,
+ * the barrier, the input ranges, the counters and the partitions.
+ * @param jc the job, created by createJobContext.
+ * @param multiThreadLevel the number of threads that run the job.
+ */
+void initJobThreads(JobContext *jc, int multiThreadLevel)
+{
+  jc->MT_LEVEL = multiThreadLevel;
+  jc->tContexts = new ThreadContext[multiThreadLevel];
+  jc->barrier = new Barrier(multiThreadLevel);
+  initThreadContexts (jc->tContexts, multiThreadLevel, jc);
+  jc->pendingFlushes = multiThreadLevel;
+  // every thread starts with an equal slice of the input.
+  jc->mapRanges = new MapRange[multiThreadLevel];
+  uint64_t inputVecSize = jc->inputVec->size ();
+  for (int i = 0; i < multiThreadLevel; ++i)
+    {
+      uint64_t begin = inputVecSize * i / multiThreadLevel;
+      uint64_t end = inputVecSize * (i + 1) / multiThreadLevel;
+      jc->mapRanges[i].range.store ((begin << 32) | end);
+    }
+  jc->stats = new ThreadCounters[multiThreadLevel];
+  for (int i = 0; i < multiThreadLevel; ++i)
+    {
+      ThreadCounters &counters = jc->stats[i];
+      counters.mapNs = counters.sortNs = counters.barrierNs = counters.shuffleNs = 0;
+      counters.reduceNs = counters.lockWaitNs = counters.pairsEmitted = counters.pairsCombined = 0;
+      counters.bytesAllocated = 0;
+    }
+}
+
+/**
+ * initializes every thread context, and allocates its buffers unless the job runs on a pool
+ * (a pool job uses the buffers of its workers, see bind_worker).
+ * @param tContexts the thread contexts to initialize.
+ * @param len the number of thread contexts (the number of threads).
+ * @param jc the job the threads run.
+ */
+void initThreadContexts(ThreadContext *tContexts, int len, JobContext *jc)
+{
+  for (int i = 0; i < len; ++i)
+    {
+      if (jc->pool == nullptr)
+        {
+          alloc_buffers (tContexts + i, len * PARTITIONS_PER_THREAD);
+        }
+      tContexts[i].id = i;
+      tContexts[i].jobC = jc;
+      tContexts[i].worker = nullptr;
+      tContexts[i].spilledPairs = 0;
+      tContexts[i].spilling = false;
+      tContexts[i].combining = false;
+    }
+}
+
+/**
+ * allocates the buffers of a thread context.
+ * @param buckets the number of buckets, enough for the partitions of any job it runs.
+ */
+void alloc_buffers(ThreadContext *tc, int buckets)
+{
+  tc->intermediateVec = new IntermediateVec;
+  tc->buckets = new IntermediateVec[buckets];
+  tc->ownGroups = new std::vector<GroupSpan>;
+  tc->samples = new std::vector<K2 *>;
+  tc->keyRange = new IntermediateVec;
+  tc->prefixes = new std::vector<PrefixEntry>;
+  tc->prefixesTmp = new std::vector<PrefixEntry>;
+  tc->sortedPairs = new IntermediateVec;
+  tc->state = new IntermediateVec;
+  tc->reduceVec = new IntermediateVec;
+  tc->outputVec = new OutputVec;
+  tc->outputRuns = new std::vector<OutputRun>;
+  tc->spillRuns = new std::vector<FILE *>;
+}
+
+/**
+ * releases the buffers of a thread context.
+ */
+void free_buffers(ThreadContext *tc)
+{
+  delete tc->intermediateVec;
+  delete[] tc->buckets;
+  delete tc->ownGroups;
+  delete tc->samples;
+  delete tc->keyRange;
+  delete tc->prefixes;
+  delete tc->prefixesTmp;
+  delete tc->sortedPairs;
+  delete tc->state;
+  delete tc->reduceVec;
+  delete tc->spillRuns;
+  delete tc->outputVec;
+  delete tc->outputRuns;
+}
+
+/**
+ * releases the buffers of every thread context (not the array itself).
+ */
+void freeThreadContexts(ThreadContext *tContexts, int len)
+{
+  for(int i = 0; i < len; i++) {
+    free_buffers (tContexts + i);
+  }
+}
+
+/**
+ * pool jobs: gives a thread context the buffers of the worker that will run it. A worker that
+ * runs a job inside another one (see preempt_map) gives it the buffers of the next nesting
+ * level, which are allocated the first time a job is nested that deep. The buckets are
+ * allocated for a job on the whole pool, so they fit every job.
+ * entryPoint empties the buffers, and they keep their memory from job to job.
+ * must be called with the pool mutex locked.
+ */
+void bind_worker(ThreadContext *tc, PoolWorker *worker)
+{
+  std::vector<ThreadContext> &buffers = *worker->buffers;
+  if ((int) buffers.size () == worker->running)
+    {
+      buffers.push_back (ThreadContext ());
+      alloc_buffers (&buffers.back (), worker->pool->MT_LEVEL * PARTITIONS_PER_THREAD);
+    }
+  copy_buffers(tc, &buffers[worker->running++]);
+  tc->worker = worker;
+}
+
+/**
+ * pool jobs: gives the buffers of a finished thread context back to its worker. (a phase may
+ * have replaced a buffer, like combine_phase does with intermediateVec.)
+ * must be called with the pool mutex locked.
+ */
+void unbind_worker(ThreadContext *tc)
+{
+  PoolWorker *worker = tc->worker;
+  copy_buffers(&(*worker->buffers)[--worker->running], tc);
+}
+
+/**
+ * points the buffers of to at the buffers of from.
+ */
+void copy_buffers(ThreadContext *to, const ThreadContext *from)
+{
+  to->intermediateVec = from->intermediateVec;
+  to->buckets = from->buckets;
+  to->ownGroups = from->ownGroups;
+  to->samples = from->samples;
+  to->keyRange = from->keyRange;
+  to->prefixes = from->prefixes;
+  to->prefixesTmp = from->prefixesTmp;
+  to->sortedPairs = from->sortedPairs;
+  to->state = from->state;
+  to->reduceVec = from->reduceVec;
+  to->outputVec = from->outputVec;
+  to->outputRuns = from->outputRuns;
+  to->spillRuns = from->spillRuns;
+}
+
+/**
+ * the loop of a pool worker: waits until it is given a thread context of a job, runs it, and
+ * starts waiting jobs on the idle workers when it is done.
+ * @param arg the worker.
+ * @return nullptr
+ */
+void *poolEntryPoint (void *arg)
+{
+  PoolWorker *worker = (PoolWorker *) arg;
+  JobPool *pool = worker->pool;
+  if (pool->pinThreads)
+    {
+      pin_thread((int) (worker - pool->workers));
+    }
+  lockThread(&pool->mutex);
+  while (true)
+    {
+      while (worker->slot == nullptr && !pool->closing)
+        {
+          waitCond(&pool->workCv, &pool->mutex);
+        }
+      if (worker->slot == nullptr)
+        {
+          // the pool is closing, and no job is left.
+          unlockThread(&pool->mutex);
+          return nullptr;
+        }
+      ThreadContext *tc = worker->slot;
+      worker->slot = nullptr;
+      unlockThread(&pool->mutex);
+
+      entryPoint(tc);
+
+      lockThread(&pool->mutex);
+      finish_slot(pool, tc);
+      worker->idle = true;
+      pool->idle++;
+      schedule_jobs(pool);
+    }
+}
+
+/**
+ * called between two map items of a pool job when a job of a higher priority waits for
+ * workers. The worker starts that job (with itself and the idle workers) and runs its first
+ * thread context before it goes back to tc. The other threads of the job of tc go on mapping
+ * and then wait for it at the first barrier.
+ * A job is only ever preempted by a job of a higher priority, so the job of the highest
+ * priority always has all its threads running, and the nested jobs cannot deadlock.
+ * @param tc the thread context that is preempted.
+ */
+void preempt_map(ThreadContext *tc)
+{
+  PoolWorker *worker = tc->worker;
+  JobPool *pool = worker->pool;
+  lockThread(&pool->mutex);
+  if (pool->topPending.load () <= tc->jobC->config.priority)
+    {
+      // another worker started the job already.
+      unlockThread(&pool->mutex);
+      return;
+    }
+  JobContext *jc = pop_pending(pool);
+  start_job(pool, jc, worker);
+  unlockThread(&pool->mutex);
+
+  entryPoint(jc->tContexts);
+
+  lockThread(&pool->mutex);
+  finish_slot(pool, jc->tContexts);
+  unlockThread(&pool->mutex);
+}
+
+/**
+ * the number of threads a job gets when it starts: its part of the pool by its weight out of
+ * the weights of all the unfinished jobs, at least 1.
+ * must be called with the pool mutex locked.
+ */
+int job_share(JobPool *pool, JobContext *jc)
+{
+  uint64_t share = pool->MT_LEVEL * (uint64_t) std::max (jc->config.weight, 1u) / pool->weights;
+  return (int) std::max (share, (uint64_t) 1);
+}
+
+/**
+ * starts a job on the idle workers, up to its share of the pool.
+ * must be called with the pool mutex locked.
+ * @param self a worker that runs the first thread context of the job by itself (see
+ * preempt_map), or nullptr.
+ */
+void start_job(JobPool *pool, JobContext *jc, PoolWorker *self)
+{
+  int available = pool->idle + (self != nullptr ? 1 : 0);
+  int threads = std::min (job_share(pool, jc), available);
+  initJobThreads (jc, threads);
+  jc->slotsRunning = threads;
+  int next = 0;
+  if (self != nullptr)
+    {
+      bind_worker(jc->tContexts + next++, self);
+    }
+  for (int i = 0; i < pool->MT_LEVEL && next < threads; ++i)
+    {
+      PoolWorker *worker = pool->workers + i;
+      if (worker->idle)
+        {
+          worker->idle = false;
+          worker->slot = jc->tContexts + next;
+          bind_worker(jc->tContexts + next++, worker);
+          pool->idle--;
+        }
+    }
+  broadcastCond(&pool->workCv);
+}
+
+/**
+ * removes the next job to start from the waiting jobs: the first of the highest priority.
+ * must be called with the pool mutex locked, and pending must not be empty.
+ */
+JobContext *pop_pending(JobPool *pool)
+{
+  std::deque<JobContext *>::iterator next = pool->pending.begin ();
+  for (std::deque<JobContext *>::iterator it = next; it != pool->pending.end (); ++it)
+    {
+      if ((*it)->config.priority > (*next)->config.priority)
+        {
+          next = it;
+        }
+    }
+  JobContext *jc = *next;
+  pool->pending.erase (next);
+  int top = INT_MIN;
+  for (JobContext *waiting : pool->pending)
+    {
+      top = std::max (top, waiting->config.priority);
+    }
+  pool->topPending.store (top);
+  return jc;
+}
+
+/**
+ * starts waiting jobs while there are idle workers.
+ * must be called with the pool mutex locked.
+ */
+void schedule_jobs(JobPool *pool)
+{
+  while (pool->idle > 0 && !pool->pending.empty ())
+    {
+      start_job(pool, pop_pending(pool), nullptr);
+    }
+}
+
+/**
+ * called when a worker finished running a thread context of a job. The last one finishes the job.
+ * must be called with the pool mutex locked.
+ */
+void finish_slot(JobPool *pool, ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  unbind_worker(tc);
+  if (--jc->slotsRunning == 0)
+    {
+      // the job may be released as soon as the mutex is unlocked.
+      pool->unfinished--;
+      pool->weights -= std::max (jc->config.weight, 1u);
+      jc->finished = true;
+      broadcastCond(&pool->doneCv);
+    }
+}
+
+/**
+ * creates a pool of worker threads that runs the submitted jobs.
+ * @param multiThreadLevel the number of worker threads in the pool.
+ * @param pinThreads pin worker i to a cpu, like JobConfig::pinThreads does for thread i of a job.
+ * @return an identifier of the pool.
+ */
+JobPoolHandle createJobPool (int multiThreadLevel, bool pinThreads)
+{
+  JobPool *pool = new JobPool;
+  pool->MT_LEVEL = multiThreadLevel;
+  pool->threads = new pthread_t[multiThreadLevel];
+  pool->workers = new PoolWorker[multiThreadLevel];
+  pool->mutex = PTHREAD_MUTEX_INITIALIZER;
+  pool->workCv = PTHREAD_COND_INITIALIZER;
+  pool->doneCv = PTHREAD_COND_INITIALIZER;
+  pool->topPending = INT_MIN;
+  pool->idle = multiThreadLevel;
+  pool->unfinished = 0;
+  pool->weights = 0;
+  pool->pinThreads = pinThreads;
+  pool->closing = false;
+  for (int i = 0; i < multiThreadLevel; ++i)
+    {
+      pool->workers[i].pool = pool;
+      pool->workers[i].slot = nullptr;
+      pool->workers[i].idle = true;
+      pool->workers[i].buffers = new std::vector<ThreadContext>;
+      pool->workers[i].running = 0;
+    }
+  for (int i = 0; i < multiThreadLevel; i++)
+    {
+      if (pthread_create (pool->threads + i, NULL, poolEntryPoint, pool->workers + i) != 0)
+        {
+          std::cerr << PTHREAD_CREATE_FAIL_MSG << std::endl;
+          exit (1);
+        }
+    }
+  return (JobPoolHandle) pool;
+}
+
+/**
+ * submits a job to a pool. The job starts when some workers of the pool are idle, or when it
+ * preempts a job of a lower priority. Like any job, it must be closed with closeJobHandle.
+ * @param poolHandle the pool returned by createJobPool.
+ * @param config the configuration of the job, including its priority and weight.
+ * @return an identifier of the job.
+ */
+JobHandle submitMapReduceJob (JobPoolHandle poolHandle, const MapReduceClient &client,
+                              const InputVec &inputVec, OutputVec &outputVec,
+                              const JobConfig &config)
+{
+  JobPool *pool = (JobPool *) poolHandle;
+  JobContext *jc = createJobContext (client, inputVec, outputVec, config);
+  jc->pool = pool;
+
+  lockThread(&pool->mutex);
+  pool->unfinished++;
+  pool->weights += std::max (config.weight, 1u);
+  pool->pending.push_back (jc);
+  if (config.priority > pool->topPending.load ())
+    {
+      pool->topPending.store (config.priority);
+    }
+  schedule_jobs(pool);
+  unlockThread(&pool->mutex);
+  return (JobHandle) jc;
+}
+
+/**
+ * waits for all the jobs submitted to the pool to finish, stops its threads and releases it.
+ * The jobs themselves must still be closed with closeJobHandle.
+ * @param poolHandle the pool returned by createJobPool.
+ */
+void closeJobPool (JobPoolHandle poolHandle)
+{
+  JobPool *pool = (JobPool *) poolHandle;
+  lockThread(&pool->mutex);
+  while (pool->unfinished != 0)
+    {
+      waitCond(&pool->doneCv, &pool->mutex);
+    }
+  pool->closing = true;
+  broadcastCond(&pool->workCv);
+  unlockThread(&pool->mutex);
+
+  for (int i = 0; i < pool->MT_LEVEL; ++i)
+    {
+      if (pthread_join (pool->threads[i], nullptr) != 0)
+        {
+          std::cerr << PTHREAD_JOIN_FAIL_MSG << std::endl;
+          exit (1);
+        }
+    }
+  if (pthread_mutex_destroy (&pool->mutex) != 0)
+    {
+      fprintf (stderr, PTHREAD_DESTROY_FAIL_MSG);
+      exit (1);
+    }
+  if (pthread_cond_destroy (&pool->workCv) != 0 || pthread_cond_destroy (&pool->doneCv) != 0)
+    {
+      fprintf (stderr, PTHREAD_COND_FAIL_MSG);
+      exit (1);
+    }
+  for (int i = 0; i < pool->MT_LEVEL; ++i)
+    {
+      for (ThreadContext &buffers : *pool->workers[i].buffers)
+        {
+          free_buffers (&buffers);
+        }
+      delete pool->workers[i].buffers;
+    }
+  delete[] pool->workers;
+  delete[] pool->threads;
+  delete pool;
+}
+
+/**
+ * the loop of a thread of a stream job: maps chunks of the pushed input while there is any,
+ * and runs every flush with the other threads.
+ * @param arg the thread context of the thread.
+ * @return nullptr
+ */
+void *streamEntryPoint (void *arg)
+{
+  ThreadContext *tc = (ThreadContext *) arg;
+  JobContext *jc = tc->jobC;
+  StreamJob *stream = jc->stream;
+  unsigned long flushes = 0;
+  InputVec chunk;
+  if (jc->config.pinThreads)
+    {
+      pin_thread(tc->id);
+    }
+  lockThread(&stream->mutex);
+  while (true)
+    {
+      while (stream->queue.empty () && stream->flushes == flushes && !stream->closing)
+        {
+          waitCond(&stream->workCv, &stream->mutex);
+        }
+      if (stream->flushes != flushes)
+        {
+          flushes = stream->flushes;
+          unlockThread(&stream->mutex);
+          stream_flush_phase(tc);
+          lockThread(&stream->mutex);
+          if (--stream->flushing == 0)
+            {
+              broadcastCond(&stream->doneCv);
+            }
+          continue;
+        }
+      if (stream->queue.empty ())
+        {
+          // closing, and the last window was flushed.
+          unlockThread(&stream->mutex);
+          return nullptr;
+        }
+      // like the map phase, a chunk is a part of what is left, so the threads share the input.
+      size_t size = std::max (stream->queue.size () / (jc->MT_LEVEL * MAP_CHUNK_DIVISOR), (size_t) 1);
+      chunk.assign (stream->queue.begin (), stream->queue.begin () + size);
+      stream->queue.erase (stream->queue.begin (), stream->queue.begin () + size);
+      stream->mapping++;
+      unlockThread(&stream->mutex);
+
+      uint64_t time = now_ns();
+      for (const InputPair &pair : chunk)
+        {
+          jc->client->map (pair.first, pair.second, tc);
+        }
+      add_time(jc->stats[tc->id].mapNs, time);
+      *(jc->atomicFinishMap) += (uint32_t) chunk.size ();
+
+      lockThread(&stream->mutex);
+      if (--stream->mapping == 0 && stream->queue.empty ())
+        {
+          broadcastCond(&stream->doneCv);
+        }
+    }
+}
+
+/**
+ * stream jobs: ends a window. Every thread partitions the pairs it emitted in the window by
+ * ClientHooks::hashKey, collects its partition from all the threads, folds it into the state
+ * of its keys and reduces the keys that changed. All threads run this phase together.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ */
+void stream_flush_phase(ThreadContext *tc)
+{
+  JobContext *jc = tc->jobC;
+  ThreadCounters *stats = jc->stats + tc->id;
+  uint64_t time = now_ns();
+  tc->outputVec->clear ();
+  tc->outputRuns->clear ();
+  if (jc->config.combine)
+    {
+      sort_pairs(tc, tc->intermediateVec);
+      combine_phase(tc);
+    }
+  partition_phase(tc);
+  update_bytes(tc, true);
+  time = add_time(stats->sortNs, time);
+
+  // barrier until all the threads partitioned their pairs
+  wait_barrier(tc);
+  time = now_ns();
+  // numPairs holds all the pairs of the window now.
+  advance_stage(jc, MAP_STAGE, SHUFFLE_STAGE);
+  IntermediateVec *window = tc->keyRange;
+  window->clear ();
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      IntermediateVec &part = jc->tContexts[i].buckets[tc->id];
+      window->insert (window->end (), part.begin (), part.end ());
+      // clear() keeps the memory of the part for the next windows.
+      part.clear ();
+    }
+  sort_pairs(tc, window);
+  *(jc->atomicShuffle) += (uint32_t) window->size ();
+  time = add_time(stats->shuffleNs, time);
+  advance_stage(jc, SHUFFLE_STAGE, REDUCE_STAGE);
+
+  fold_state(tc, window);
+  // OUTPUT PHASE - the output of the threads is appended to outputVec
+  output_phase(tc);
+  update_bytes(tc, false);
+  add_time(stats->reduceNs, time);
+}
+
+/**
+ * stream jobs: merges the sorted pairs of a window into the sorted state of the keys of this
+ * thread. For every key in the window, its state and its new pairs are combined into its new
+ * state, and reduce is called on the new state.
+ * @param tc struct which includes all the parameters which are relevant to the thread.
+ * Each thread has its own thread context.
+ * @param window the pairs of the window that belong to this thread, sorted.
+ */
+void fold_state(ThreadContext *tc, IntermediateVec *window)
+{
+  JobContext *jc = tc->jobC;
+  IntermediateVec *state = tc->state;
+  IntermediateVec *group = tc->reduceVec;
+  IntermediateVec folded;
+  folded.reserve (state->size () + window->size ());
+  size_t old = 0;
+  size_t start = 0;
+  while (start < window->size ())
+    {
+      K2 *key = (*window)[start].first;
+      // the keys that are not in the window keep their state.
+      while (old < state->size () && *(*state)[old].first < *key)
+        {
+          folded.push_back ((*state)[old++]);
+        }
+      group->clear ();
+      while (old < state->size () && !(*key < *(*state)[old].first))
+        {
+          group->push_back ((*state)[old++]);
+        }
+      size_t first = start;
+      while (start < window->size () && !(*key < *(*window)[start].first))
+        {
+          group->push_back ((*window)[start++]);
+        }
+      // emit2 of the combiner writes into intermediateVec, which is empty until the next window.
+      tc->combining = true;
+      jc->config.hooks->combine (group, tc);
+      tc->combining = false;
+      group->assign (tc->intermediateVec->begin (), tc->intermediateVec->end ());
+      tc->intermediateVec->clear ();
+      folded.insert (folded.end (), group->begin (), group->end ());
+      jc->client->reduce (group, tc);
+      // the progress of the window is counted in its own pairs, the state is not.
+      *(jc->atomicReduce) += (uint32_t) (start - first);
+    }
+  folded.insert (folded.end (), state->begin () + old, state->end ());
+  state->swap (folded);
+}
+
+/**
+ * starts a stream job: its threads wait for input from pushStreamInput.
+ * @param client the client, whose reduce gets the state of the keys without owning it.
+ * @param outputVec the output of every window is appended to it.
+ * @param multiThreadLevel the number of threads of the job.
+ * @param config the configuration of the job, it must have client hooks.
+ * @param windowSize the number of input pairs after which a window is flushed, or 0.
+ * @return an identifier of the job.
+ */
+StreamJobHandle startStreamJob (const MapReduceClient &client, OutputVec &outputVec,
+                                int multiThreadLevel, const JobConfig &config, size_t windowSize)
+{
+  if (config.hooks == nullptr)
+    {
+      std::cerr << NO_HOOKS_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  if (config.spillThreshold != 0 || config.orderedOutput)
+    {
+      std::cerr << STREAM_CONFIG_FAIL_MSG << std::endl;
+      exit (1);
+    }
+  StreamJob *stream = new StreamJob;
+  // the keys of a window are partitioned like in HASH_SHUFFLE.
+  JobConfig streamConfig = config;
+  streamConfig.shuffle = HASH_SHUFFLE;
+  JobContext *jc = createJobContext (client, stream->noInput, outputVec, streamConfig);
+  initJobThreads (jc, multiThreadLevel);
+  jc->stream = stream;
+  stream->jc = jc;
+  stream->mutex = PTHREAD_MUTEX_INITIALIZER;
+  stream->workCv = PTHREAD_COND_INITIALIZER;
+  stream->doneCv = PTHREAD_COND_INITIALIZER;
+  stream->mapping = 0;
+  stream->flushes = 0;
+  stream->flushing = 0;
+  stream->windowSize = windowSize;
+  stream->windowPairs = 0;
+  stream->closing = false;
+  jc->threads = new pthread_t[multiThreadLevel];
+  for (int i = 0; i < multiThreadLevel; i++)
+    {
+      if (pthread_create (jc->threads + i, NULL, streamEntryPoint, jc->tContexts + i) != 0)
+        {
+          std::cerr << PTHREAD_CREATE_FAIL_MSG << std::endl;
+          exit (1);
+        }
+    }
+  return (StreamJobHandle) stream;
+}
+
+/**
+ * adds a batch of input to the current window, where the threads map it right away.
+ * flushes the window if it reached the window size of the job.
+ * @param job the stream job.
+ * @param batch the input pairs, valid until the window is flushed.
+ */
+void pushStreamInput (StreamJobHandle job, const InputVec &batch)
+{
+  StreamJob *stream = (StreamJob *) job;
+  JobContext *jc = stream->jc;
+  lockThread(&stream->mutex);
+  if (stream->windowPairs == 0)
+    {
+      // the first batch of a window: the job goes back to the map stage, for this window.
+      *(jc->atomicFinishMap) = 0;
+      stream->windowPairs += batch.size ();
+      (jc->stage) = MAP_STAGE;
+    }
+  else
+    {
+      stream->windowPairs += batch.size ();
+    }
+  stream->queue.insert (stream->queue.end (), batch.begin (), batch.end ());
+  bool full = stream->windowSize != 0 && stream->windowPairs >= stream->windowSize;
+  broadcastCond(&stream->workCv);
+  unlockThread(&stream->mutex);
+  if (full)
+    {
+      flushStreamJob (job);
+    }
+}
+
+/**
+ * ends the current window: waits until its input is mapped, then all the threads reduce it
+ * and append the output to outputVec.
+ * @param job the stream job.
+ */
+void flushStreamJob (StreamJobHandle job)
+{
+  StreamJob *stream = (StreamJob *) job;
+  lockThread(&stream->mutex);
+  while (!stream->queue.empty () || stream->mapping != 0)
+    {
+      waitCond(&stream->doneCv, &stream->mutex);
+    }
+  // the counters of the shuffle and reduce stages of the window, set before the threads enter them.
+  JobContext *jc = stream->jc;
+  *(jc->numPairs) = 0;
+  *(jc->atomicShuffle) = 0;
+  *(jc->atomicReduce) = 0;
+  stream->windowPairs = 0;
+  stream->flushing = jc->MT_LEVEL;
+  stream->flushes++;
+  broadcastCond(&stream->workCv);
+  while (stream->flushing != 0)
+    {
+      waitCond(&stream->doneCv, &stream->mutex);
+    }
+  unlockThread(&stream->mutex);
+}
+
+/**
+ * the job that runs a stream, for getJobState, getJobStats and dumpJobStats.
+ * @param job the stream job.
+ * @return the job, which is released by closeStreamJob (not by closeJobHandle).
+ */
+JobHandle getStreamJobHandle (StreamJobHandle job)
+{
+  return (JobHandle) ((StreamJob *) job)->jc;
+}
+
+/**
+ * flushes the last window, stops the threads of the job and releases it with the state of
+ * all its keys (the pairs of the state are deleted).
+ * @param job the stream job.
+ */
+void closeStreamJob (StreamJobHandle job)
+{
+  StreamJob *stream = (StreamJob *) job;
+  JobContext *jc = stream->jc;
+  flushStreamJob (job);
+  lockThread(&stream->mutex);
+  stream->closing = true;
+  broadcastCond(&stream->workCv);
+  unlockThread(&stream->mutex);
+  waitForJob ((JobHandle) jc);
+
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      for (IntermediatePair &pair : *jc->tContexts[i].state)
+        {
+          delete pair.first;
+          delete pair.second;
+        }
+    }
+  closeJobHandle ((JobHandle) jc);
+  if (pthread_mutex_destroy (&stream->mutex) != 0)
+    {
+      fprintf (stderr, PTHREAD_DESTROY_FAIL_MSG);
+      exit (1);
+    }
+  if (pthread_cond_destroy (&stream->workCv) != 0 || pthread_cond_destroy (&stream->doneCv) != 0)
+    {
+      fprintf (stderr, PTHREAD_COND_FAIL_MSG);
+      exit (1);
+    }
+  delete stream;
+}
+
+/**
+ * the cpus this process may run on, node after node (all the cpus of node 0 first), so that
+ * threads with close ids are pinned to the same node. Read once.
+ */
+const std::vector<int> &cpu_order()
+{
+  static const std::vector<int> order = read_cpu_order();
+  return order;
+}
+
+/**
+ * reads the cpus of every NUMA node from NODE_CPULIST_PATH, keeping only the cpus in the
+ * affinity mask of the process. Cpus that no node lists (or all of them, without the node
+ * information) are added at the end in their order.
+ * @return the cpus in the order of their nodes.
+ */
+std::vector<int> read_cpu_order()
+{
+  cpu_set_t allowed;
+  CPU_ZERO (&allowed);
+  if (sched_getaffinity (0, sizeof (allowed), &allowed) != 0)
+    {
+      fprintf (stderr, AFFINITY_FAIL_MSG);
+      exit (1);
+    }
+  std::vector<int> order;
+  std::vector<bool> listed (CPU_SETSIZE, false);
+  for (int node = 0; node < MAX_NUMA_NODES; ++node)
+    {
+      char path[sizeof (NODE_CPULIST_PATH) + 16];
+      snprintf (path, sizeof (path), NODE_CPULIST_PATH, node);
+      FILE *file = fopen (path, "r");
+      if (file == nullptr)
+        {
+          continue;
+        }
+      int first = 0;
+      while (fscanf (file, "%d", &first) == 1)
+        {
+          int last = first;
+          int next = fgetc (file);
+          if (next == '-')
+            {
+              if (fscanf (file, "%d", &last) != 1)
+                {
+                  break;
+                }
+              next = fgetc (file);
+            }
+          for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+            {
+              if (CPU_ISSET (cpu, &allowed) && !listed[cpu])
+                {
+                  order.push_back (cpu);
+                  listed[cpu] = true;
+                }
+            }
+          if (next != ',')
+            {
+              break;
+            }
+        }
+      fclose (file);
+    }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+      if (CPU_ISSET (cpu, &allowed) && !listed[cpu])
+        {
+          order.push_back (cpu);
+        }
+    }
+  return order;
+}
+
+/**
+ * pins the calling thread to cpu number index of cpu_order (round robin when there are more
+ * threads than cpus). A thread calls it before it touches its buffers, so that the pages of
+ * the buffers are allocated on its own node (the kernel allocates a page on the node of the
+ * thread that touches it first).
+ * @param index the id of the thread in its job or pool.
+ */
+void pin_thread(int index)
+{
+  const std::vector<int> &order = cpu_order();
+  cpu_set_t cpus;
+  CPU_ZERO (&cpus);
+  CPU_SET (order[index % order.size ()], &cpus);
+  if (pthread_setaffinity_np (pthread_self (), sizeof (cpus), &cpus) != 0)
+    {
+      fprintf (stderr, AFFINITY_FAIL_MSG);
+      exit (1);
+    }
+}
+
+/**
+ *  a function gets JobHandle returned by startMapReduceFramework and waits
+ *  until it is finished.
+ * @param job an identifier of a running job.
+ */
+void waitForJob (JobHandle job)
+{
+
+  JobContext *jc = (JobContext *) job;
+
+  if (jc->pool != nullptr)
+    {
+      // the threads belong to the pool, we only wait for the last of them to finish the job.
+      lockThread(&jc->pool->mutex);
+      while (!jc->finished)
+        {
+          waitCond(&jc->pool->doneCv, &jc->pool->mutex);
+        }
+      unlockThread(&jc->pool->mutex);
+      return;
+    }
+
+  lockThread(jc->mutexJoin);
+    if (jc->flagJoin)
+    {
+      unlockThread(jc->mutexJoin);
+      return;
+    }
+  jc->flagJoin = true;
+  unlockThread(jc->mutexJoin);
+
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      if (pthread_join (jc->threads[i], nullptr) != 0)
+        {
+          std::cerr << PTHREAD_JOIN_FAIL_MSG << std::endl;
+          exit (1);
+        }
+    }
+
+  delete[] jc->threads;
+  jc->threads = nullptr;
+
+}
+
+/**
+ * locks mutex, and counts the time it took in the lock wait statistics of the thread.
+ */
+void lockTimed(ThreadContext *tc, pthread_mutex_t *mutex)
+{
+  uint64_t time = now_ns();
+  lockThread(mutex);
+  add_time(tc->jobC->stats[tc->id].lockWaitNs, time);
+}
+
+/**
+ * waits on cv, and counts the time it took in the lock wait statistics of the thread.
+ */
+void waitCondTimed(ThreadContext *tc, pthread_cond_t *cv, pthread_mutex_t *mutex)
+{
+  uint64_t time = now_ns();
+  waitCond(cv, mutex);
+  add_time(tc->jobC->stats[tc->id].lockWaitNs, time);
+}
+
+/**
+ * waits at the barrier of the job, and counts the time it took in the barrier statistics.
+ */
+void wait_barrier(ThreadContext *tc)
+{
+  uint64_t time = now_ns();
+  tc->jobC->barrier->barrier();
+  add_time(tc->jobC->stats[tc->id].barrierNs, time);
+}
+
+/**
+ * moves the job from stage from to stage to, if it is still in stage from.
+ * @return true if this call changed the stage.
+ */
+bool advance_stage(JobContext *jc, stage_t from, stage_t to)
+{
+  return jc->stage.compare_exchange_strong (from, to);
+}
+
+/**
+ * @return a monotonic time in nanoseconds.
+ */
+uint64_t now_ns()
+{
+  return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>
+      (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/**
+ * adds the time passed since since to stat.
+ * @return the current time, to be used as since of the next phase.
+ */
+uint64_t add_time(std::atomic<uint64_t> &stat, uint64_t since)
+{
+  uint64_t now = now_ns();
+  add_stat(stat, now - since);
+  return now;
+}
+
+/**
+ * adds value to a counter that only the calling thread writes (so no read-modify-write is needed).
+ */
+void add_stat(std::atomic<uint64_t> &stat, uint64_t value)
+{
+  stat.store (stat.load (std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * records the current size of the buffers of the thread, if it is the largest seen so far.
+ * the buckets are counted only while the thread still owns them (before the shuffle, other
+ * threads may empty them).
+ */
+void update_bytes(ThreadContext *tc, bool withBuckets)
+{
+  int partitions = withBuckets ? tc->jobC->MT_LEVEL * PARTITIONS_PER_THREAD : 0;
+  uint64_t pairs = tc->intermediateVec->capacity () + tc->reduceVec->capacity ()
+                   + tc->sortedPairs->capacity () + tc->state->capacity ();
+  for (int p = 0; p < partitions; ++p)
+    {
+      pairs += tc->buckets[p].capacity ();
+    }
+  uint64_t bytes = pairs * sizeof (IntermediatePair) + tc->outputVec->capacity () * sizeof (OutputPair);
+  std::atomic<uint64_t> &stat = tc->jobC->stats[tc->id].bytesAllocated;
+  if (bytes > stat.load (std::memory_order_relaxed))
+    {
+      stat.store (bytes, std::memory_order_relaxed);
+    }
+}
+
+void lockThread(pthread_mutex_t* mutex) {
     if (pthread_mutex_lock (mutex) != 0)
       {
         fprintf (stderr, PTHREAD_LOCK_FAIL_MSG);
@@ -372,6 +2526,22 @@ void unlockThread(pthread_mutex_t* mutex) {
     }
 }
 
+void waitCond(pthread_cond_t *cv, pthread_mutex_t *mutex) {
+    if (pthread_cond_wait (cv, mutex) != 0)
+      {
+        fprintf (stderr, PTHREAD_COND_FAIL_MSG);
+        exit (1);
+      }
+}
+
+void broadcastCond(pthread_cond_t *cv) {
+    if (pthread_cond_broadcast (cv) != 0)
+      {
+        fprintf (stderr, PTHREAD_COND_FAIL_MSG);
+        exit (1);
+      }
+}
+
 /**
  * this function gets a JobHandle and updates the state of the job into the given
  * JobState struct.
@@ -381,37 +2551,109 @@ void unlockThread(pthread_mutex_t* mutex) {
 void getJobState (JobHandle job, JobState *state)
 {
   // Only main thread can get in this function.
-  // because the user in using this func, and only has access to the main thread. So there's no need of mutex.
+  // The threads change the stage and the counters while we read them, so all of them are atomic.
+  // The stage is read first: the counters of a stage are set before the stage is entered.
 
   JobContext *jc = (JobContext *) job;
 
+    stage_t stage = jc->stage.load();
     unsigned int finishedMap = (jc->atomicFinishMap->load());
     unsigned int finished1 = (jc->atomicShuffle->load());
     unsigned int finished2 = (jc->atomicReduce->load());
-    float inputVecSize = (float) jc->inputVec->size();
-    int numPairs = *jc->numPairs;
+    // a stream job maps the input of its current window.
+    unsigned int inputVecSize = jc->stream != nullptr ? (unsigned int) jc->stream->windowPairs.load ()
+                                                      : (unsigned int) jc->inputVec->size();
+    unsigned int numPairs = jc->numPairs->load();
 
-    if ((jc->stage) == UNDEFINED_STAGE)
+    state->stage = stage;
+    if (stage == UNDEFINED_STAGE)
     {
         state->percentage = 0;
-        state->stage = UNDEFINED_STAGE;
     }
-    else if ((jc->stage) == MAP_STAGE)
+    else if (stage == MAP_STAGE)
     {
-        state->stage = MAP_STAGE;
-
-        state->percentage = (float) finishedMap / inputVecSize * 100;
+        state->percentage = percentage (finishedMap, inputVecSize);
     }
-    else if ((jc->stage) == SHUFFLE_STAGE) {
-        state->stage = SHUFFLE_STAGE;
-        state->percentage = ((float)finished1 / (float) numPairs) * 100;
+    else if (stage == SHUFFLE_STAGE) {
+        state->percentage = percentage (finished1, numPairs);
     }
-    else if ((jc->stage) == REDUCE_STAGE) {
-        state->stage = REDUCE_STAGE;
-        state->percentage = ((float) finished2 / (float) numPairs) * 100;
+    else if (stage == REDUCE_STAGE) {
+        state->percentage = percentage (finished2, numPairs);
   }
 }
 
+/**
+ * @return done out of total in percents, 100 if there is nothing to do.
+ */
+float percentage (unsigned int done, unsigned int total)
+{
+  if (total == 0)
+    {
+      return 100;
+    }
+  return (float) done / (float) total * 100;
+}
+
+/**
+ * fills stats with the current state and per thread statistics of a job.
+ * @param job an identifier of a running job.
+ * @param stats the statistics to fill.
+ */
+void getJobStats (JobHandle job, JobStats *stats)
+{
+  JobContext *jc = (JobContext *) job;
+  getJobState (job, &stats->state);
+  if (jc->pool != nullptr && stats->state.stage == UNDEFINED_STAGE)
+    {
+      // the pool may be giving the job its threads right now.
+      stats->threads.clear ();
+      return;
+    }
+  stats->threads.resize (jc->MT_LEVEL);
+  for (int i = 0; i < jc->MT_LEVEL; ++i)
+    {
+      ThreadCounters &counters = jc->stats[i];
+      ThreadStats &thread = stats->threads[i];
+      thread.mapNs = counters.mapNs.load (std::memory_order_relaxed);
+      thread.sortNs = counters.sortNs.load (std::memory_order_relaxed);
+      thread.barrierNs = counters.barrierNs.load (std::memory_order_relaxed);
+      thread.shuffleNs = counters.shuffleNs.load (std::memory_order_relaxed);
+      thread.reduceNs = counters.reduceNs.load (std::memory_order_relaxed);
+      thread.lockWaitNs = counters.lockWaitNs.load (std::memory_order_relaxed);
+      thread.pairsEmitted = counters.pairsEmitted.load (std::memory_order_relaxed);
+      thread.pairsCombined = counters.pairsCombined.load (std::memory_order_relaxed);
+      thread.bytesAllocated = counters.bytesAllocated.load (std::memory_order_relaxed);
+    }
+}
+
+/**
+ * writes the statistics of a job to file as a single JSON object:
+ * {"stage": .., "percentage": .., "threads": [{"id": .., "map_ns": .., ...}, ...]}
+ * @param job an identifier of a running job.
+ * @param file the file to write to.
+ */
+void dumpJobStats (JobHandle job, FILE *file)
+{
+  JobStats stats;
+  getJobStats (job, &stats);
+  fprintf (file, "{\"stage\": %d, \"percentage\": %.2f, \"threads\": [",
+           (int) stats.state.stage, stats.state.percentage);
+  for (size_t i = 0; i < stats.threads.size (); ++i)
+    {
+      const ThreadStats &thread = stats.threads[i];
+      fprintf (file, "%s\n  {\"id\": %zu, \"map_ns\": %llu, \"sort_ns\": %llu, \"barrier_ns\": %llu, "
+                     "\"shuffle_ns\": %llu, \"reduce_ns\": %llu, \"lock_wait_ns\": %llu, "
+                     "\"pairs_emitted\": %llu, \"pairs_combined\": %llu, \"bytes_allocated\": %llu}",
+               i == 0 ? "" : ",", i,
+               (unsigned long long) thread.mapNs, (unsigned long long) thread.sortNs,
+               (unsigned long long) thread.barrierNs, (unsigned long long) thread.shuffleNs,
+               (unsigned long long) thread.reduceNs, (unsigned long long) thread.lockWaitNs,
+               (unsigned long long) thread.pairsEmitted, (unsigned long long) thread.pairsCombined,
+               (unsigned long long) thread.bytesAllocated);
+    }
+  fprintf (file, "\n]}\n");
+}
+
 /**
  * Releasing all resources of a job.
  * @param job an identifier of a running job.
@@ -428,28 +2670,35 @@ void closeJobHandle (JobHandle job)
       exit (1);
     }
   delete jc->mutexReduce;
-  if (pthread_mutex_destroy (jc->mutexOutputVec) != 0)
-    {
-      fprintf (stderr, PTHREAD_DESTROY_FAIL_MSG);
-      exit (1);
-    }
-  delete jc->mutexOutputVec;
   if (pthread_mutex_destroy (jc->mutexJoin) != 0)
     {
       fprintf (stderr, PTHREAD_DESTROY_FAIL_MSG);
       exit (1);
     }
   delete jc->mutexJoin;
-  delete jc->atomicIndexMap;
+  delete[] jc->mapRanges;
   delete jc->atomicShuffle;
   delete jc->atomicReduce;
   delete jc->atomicFinishMap;
-  delete jc->barrier;
   delete jc->numPairs;
+  delete[] jc->stats;
   delete jc->afterShuffleVec;
-  for(int i = 0; i < jc->MT_LEVEL; i++) {
-    delete jc->tContexts[i].intermediateVec;
-  }
+  // all the groups of the job are released at once.
+  delete jc->arena;
+  delete jc->spillGroups;
+  delete jc->readyPartitions;
+  if (pthread_cond_destroy (jc->reduceCv) != 0)
+    {
+      fprintf (stderr, PTHREAD_COND_FAIL_MSG);
+      exit (1);
+    }
+  delete jc->reduceCv;
+  delete jc->barrier;
+  if (jc->pool == nullptr)
+    {
+      // the buffers of a pool job belong to the workers of the pool.
+      freeThreadContexts (jc->tContexts, jc->MT_LEVEL);
+    }
   delete[] jc->tContexts;
   delete jc;
 }
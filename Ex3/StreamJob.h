@@ -0,0 +1,57 @@
+#ifndef STREAMJOB_H
+#define STREAMJOB_H
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+#include "JobConfig.h"
+
+/**
+ * a job over an input that never ends. The input is pushed in batches and mapped by the
+ * threads of the job as soon as it arrives. Every flush ends a window: the pairs emitted in it
+ * are folded into the state of their keys and the keys that changed are reduced.
+ *
+ * the state of a key is the list of its pairs after ClientHooks::combine, which is called on the
+ * previous state of the key followed by its new pairs (so a combiner that sums counts keeps a
+ * single pair per key). The keys are spread over the threads by ClientHooks::hashKey, so the
+ * job needs client hooks. The state is owned by the framework: reduce gets the new state of
+ * every key that changed, and unlike in other jobs it must not delete the pairs. The state is
+ * deleted by closeStreamJob.
+ *
+ * pushStreamInput, flushStreamJob and closeStreamJob must be called from the same thread.
+ */
+typedef void *StreamJobHandle;
+
+/**
+ * @param outputVec the output of every window is appended to it by the call that flushes it.
+ * @param config the client hooks (and optionally combine and prefixSort).
+ * @param windowSize if not 0, pushStreamInput flushes the window by itself as soon as it holds
+ * windowSize input pairs.
+ */
+StreamJobHandle startStreamJob (const MapReduceClient &client, OutputVec &outputVec,
+                                int multiThreadLevel, const JobConfig &config, size_t windowSize = 0);
+
+/**
+ * adds input pairs to the current window. The pairs must stay valid until the window is flushed.
+ */
+void pushStreamInput (StreamJobHandle job, const InputVec &batch);
+
+/**
+ * waits until all the pushed input is mapped, then reduces the window and appends its output
+ * to outputVec.
+ */
+void flushStreamJob (StreamJobHandle job);
+
+/**
+ * the job that runs the stream, to pass to getJobState, getJobStats and dumpJobStats. It is
+ * released by closeStreamJob, never by closeJobHandle.
+ * every window goes through the stages again: MAP_STAGE from its first batch on (out of the
+ * input pushed in the window so far), then SHUFFLE_STAGE and REDUCE_STAGE during its flush (out
+ * of the pairs emitted in the window). After the flush the job stays in REDUCE_STAGE at 100%.
+ */
+JobHandle getStreamJobHandle (StreamJobHandle job);
+
+/**
+ * flushes the last window, stops the threads and releases the job and the state of its keys.
+ */
+void closeStreamJob (StreamJobHandle job);
+
+#endif //STREAMJOB_H
@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <pthread.h>
+#include "Barrier.h"
+
+/**
+ * Measures the latency of a barrier against the number of threads, for Barrier and for the
+ * mutex and condition variable barrier it replaced (CondBarrier below).
+ * usage: barrier_bench [rounds] [max_threads]
+ * Every thread passes the barrier `rounds` times, and the time per round is printed. With more
+ * threads than cpus every round needs context switches, so those lines measure the scheduler
+ * as much as the barrier.
+ */
+
+#define DEFAULT_ROUNDS 20000
+#define DEFAULT_MAX_THREADS 128
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * the previous Barrier: a count under a mutex, and a broadcast by the last thread. A
+ * generation is added so a spurious wakeup does not release a thread early.
+ */
+class CondBarrier {
+public:
+    explicit CondBarrier (int numThreads) : count (0), generation (0), numThreads (numThreads)
+    {
+      pthread_mutex_init (&mutex, nullptr);
+      pthread_cond_init (&cv, nullptr);
+    }
+
+    ~CondBarrier ()
+    {
+      pthread_mutex_destroy (&mutex);
+      pthread_cond_destroy (&cv);
+    }
+
+    void barrier ()
+    {
+      pthread_mutex_lock (&mutex);
+      unsigned long current = generation;
+      if (++count < numThreads)
+        {
+          while (generation == current)
+            {
+              pthread_cond_wait (&cv, &mutex);
+            }
+        }
+      else
+        {
+          count = 0;
+          generation++;
+          pthread_cond_broadcast (&cv);
+        }
+      pthread_mutex_unlock (&mutex);
+    }
+
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;
+    int count;
+    unsigned long generation;
+    int numThreads;
+};
+
+template<class B>
+struct BenchArgs {
+    B *barrier;
+    int rounds;
+};
+
+template<class B>
+void *benchThread (void *arg)
+{
+  BenchArgs<B> *args = (BenchArgs<B> *) arg;
+  for (int i = 0; i < args->rounds; ++i)
+    {
+      args->barrier->barrier ();
+    }
+  return nullptr;
+}
+
+/**
+ * runs `threads` threads that pass the same barrier `rounds` times.
+ * @return the time of a round in nanoseconds.
+ */
+template<class B>
+double runBench (int threads, int rounds)
+{
+  B barrier (threads);
+  BenchArgs<B> args = {&barrier, rounds};
+  pthread_t *ids = new pthread_t[threads];
+  // a first round makes sure all the threads were created before the clock starts.
+  BenchArgs<B> warmup = {&barrier, 1};
+  for (int i = 0; i < threads; ++i)
+    {
+      if (pthread_create (ids + i, nullptr, benchThread<B>, &warmup) != 0)
+        {
+          fprintf (stderr, "barrier_bench: pthread_create failed\n");
+          exit (1);
+        }
+    }
+  for (int i = 0; i < threads; ++i)
+    {
+      pthread_join (ids[i], nullptr);
+    }
+
+  Clock::time_point start = Clock::now ();
+  for (int i = 0; i < threads; ++i)
+    {
+      if (pthread_create (ids + i, nullptr, benchThread<B>, &args) != 0)
+        {
+          fprintf (stderr, "barrier_bench: pthread_create failed\n");
+          exit (1);
+        }
+    }
+  for (int i = 0; i < threads; ++i)
+    {
+      pthread_join (ids[i], nullptr);
+    }
+  double ns = std::chrono::duration<double, std::nano> (Clock::now () - start).count ();
+  delete[] ids;
+  return ns / rounds;
+}
+
+int main (int argc, char **argv)
+{
+  int rounds = argc > 1 ? atoi (argv[1]) : DEFAULT_ROUNDS;
+  int maxThreads = argc > 2 ? atoi (argv[2]) : DEFAULT_MAX_THREADS;
+
+  printf ("threads,impl,rounds,ns_per_barrier\n");
+  for (int threads = 2; threads <= maxThreads; threads *= 2)
+    {
+      printf ("%d,cond,%d,%.1f\n", threads, rounds, runBench<CondBarrier> (threads, rounds));
+      fflush (stdout);
+      printf ("%d,futex,%d,%.1f\n", threads, rounds, runBench<Barrier> (threads, rounds));
+      fflush (stdout);
+    }
+  return 0;
+}
@@ -0,0 +1,462 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+#include "JobConfig.h"
+#include "JobStats.h"
+
+/**
+ * A benchmark suite of reference clients, to follow the performance of whole jobs:
+ * wordcount - counts the words of documents.
+ * index - an inverted index: the sorted list of the documents of every word.
+ * skew - a histogram of integer keys with a heavy skew (a few keys get most of the pairs).
+ * sort - sorts integer keys (with orderedOutput where the shuffle supports it).
+ * usage: mr_bench [workload|all] [input_size] [cardinality] [threads] [merge|hash|pipelined|sample]
+ * input_size is the number of words or keys in the input, cardinality the number of distinct
+ * keys they are drawn from. threads 0 (the default) runs 1, 2, 4... threads up to the number of
+ * cpus (at least 4).
+ * Every run is a separate process, so peak_rss_kb is the peak of that run alone; input_rss_kb is
+ * the peak before the job started (the generated input). Throughput is in intermediate pairs per
+ * second, and the time of a phase is the longest time a thread spent in it (from getJobStats).
+ */
+
+#define DEFAULT_INPUT_SIZE 2000000
+#define DEFAULT_CARDINALITY 10000
+#define WORDS_PER_DOC 100
+#define KEYS_PER_INPUT 1000
+// the keys of the skew workload are cardinality * u^SKEW_POWER for a uniform u in [0, 1).
+#define SKEW_POWER 4
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * the next pseudo random number of a linear congruential generator.
+ */
+static inline unsigned int next_random (unsigned int *x)
+{
+  *x = *x * 1103515245 + 12345;
+  return *x >> 8;
+}
+
+class Word : public K2, public K3 {
+public:
+    explicit Word (const std::string &word) : word (word) {}
+    bool operator< (const K2 &other) const override
+    { return word < static_cast<const Word &> (other).word; }
+    bool operator< (const K3 &other) const override
+    { return word < static_cast<const Word &> (other).word; }
+    std::string word;
+};
+
+class IntKey : public K2, public K3 {
+public:
+    explicit IntKey (unsigned int key) : key (key) {}
+    bool operator< (const K2 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    bool operator< (const K3 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    unsigned int key;
+};
+
+class Count : public V2, public V3 {
+public:
+    explicit Count (unsigned int count) : count (count) {}
+    unsigned int count;
+};
+
+class DocId : public K1, public V2 {
+public:
+    explicit DocId (unsigned int id) : id (id) {}
+    bool operator< (const K1 &other) const override
+    { return id < static_cast<const DocId &> (other).id; }
+    unsigned int id;
+};
+
+class Document : public V1 {
+public:
+    explicit Document (const std::string &text) : text (text) {}
+    std::string text;
+};
+
+class Postings : public V3 {
+public:
+    std::vector<unsigned int> docs;
+};
+
+class Seed : public V1 {
+public:
+    explicit Seed (unsigned int seed) : seed (seed) {}
+    unsigned int seed;
+};
+
+/**
+ * splits a document into its words.
+ */
+static void split_words (const std::string &text, std::vector<std::string> *words)
+{
+  size_t start = 0;
+  while (start < text.size ())
+    {
+      size_t end = text.find (' ', start);
+      if (end == std::string::npos)
+        {
+          end = text.size ();
+        }
+      if (end > start)
+        {
+          words->push_back (text.substr (start, end - start));
+        }
+      start = end + 1;
+    }
+}
+
+/**
+ * the first 8 bytes of a word, so the prefix order is the order of the words.
+ */
+static uint64_t word_prefix (const std::string &word)
+{
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < 8; ++i)
+    {
+      prefix = (prefix << 8) | (i < word.size () ? (unsigned char) word[i] : 0);
+    }
+  return prefix;
+}
+
+/**
+ * the hooks of the clients with integer keys.
+ */
+class IntKeyHooks : public ClientHooks {
+public:
+    uint64_t hashKey (const K2 *key) const override
+    {
+      return static_cast<const IntKey *> (key)->key * 2654435761u;
+    }
+
+    uint64_t sortPrefix (const K2 *key) const override
+    {
+      return static_cast<const IntKey *> (key)->key;
+    }
+};
+
+/**
+ * the hooks of the clients with word keys.
+ */
+class WordHooks : public ClientHooks {
+public:
+    uint64_t hashKey (const K2 *key) const override
+    {
+      return std::hash<std::string> () (static_cast<const Word *> (key)->word);
+    }
+
+    uint64_t sortPrefix (const K2 *key) const override
+    {
+      return word_prefix (static_cast<const Word *> (key)->word);
+    }
+};
+
+class WordCountClient : public MapReduceClient, public WordHooks {
+public:
+    void map (const K1 *key, const V1 *value, void *context) const override
+    {
+      std::vector<std::string> words;
+      split_words (static_cast<const Document *> (value)->text, &words);
+      for (const std::string &word : words)
+        {
+          emit2 (new Word (word), new Count (1), context);
+        }
+    }
+
+    void reduce (const IntermediateVec *pairs, void *context) const override
+    {
+      Word *word = new Word (static_cast<Word *> (pairs->at (0).first)->word);
+      unsigned int count = 0;
+      for (const IntermediatePair &pair : *pairs)
+        {
+          count += static_cast<Count *> (pair.second)->count;
+          delete pair.first;
+          delete pair.second;
+        }
+      emit3 (word, new Count (count), context);
+    }
+};
+
+class InvertedIndexClient : public MapReduceClient, public WordHooks {
+public:
+    void map (const K1 *key, const V1 *value, void *context) const override
+    {
+      unsigned int doc = static_cast<const DocId *> (key)->id;
+      std::vector<std::string> words;
+      split_words (static_cast<const Document *> (value)->text, &words);
+      // a word is emitted once per document.
+      std::sort (words.begin (), words.end ());
+      words.erase (std::unique (words.begin (), words.end ()), words.end ());
+      for (const std::string &word : words)
+        {
+          emit2 (new Word (word), new DocId (doc), context);
+        }
+    }
+
+    void reduce (const IntermediateVec *pairs, void *context) const override
+    {
+      Word *word = new Word (static_cast<Word *> (pairs->at (0).first)->word);
+      Postings *postings = new Postings;
+      postings->docs.reserve (pairs->size ());
+      for (const IntermediatePair &pair : *pairs)
+        {
+          postings->docs.push_back (static_cast<DocId *> (pair.second)->id);
+          delete pair.first;
+          delete pair.second;
+        }
+      std::sort (postings->docs.begin (), postings->docs.end ());
+      emit3 (word, postings, context);
+    }
+};
+
+/**
+ * every input emits KEYS_PER_INPUT pseudo random keys in [0, cardinality), and reduce counts
+ * them. The skew histogram and the sort only differ in the distribution of the keys.
+ */
+class CountKeysClient : public MapReduceClient, public IntKeyHooks {
+public:
+    CountKeysClient (unsigned int cardinality, bool skewed)
+        : cardinality (cardinality), skewed (skewed) {}
+
+    void map (const K1 *key, const V1 *value, void *context) const override
+    {
+      unsigned int x = static_cast<const Seed *> (value)->seed;
+      for (int i = 0; i < KEYS_PER_INPUT; ++i)
+        {
+          unsigned int r = next_random (&x);
+          unsigned int k = r % cardinality;
+          if (skewed)
+            {
+              double u = (r & 0xffffff) / (double) 0x1000000;
+              k = (unsigned int) (cardinality * pow (u, SKEW_POWER));
+            }
+          emit2 (new IntKey (k), new Count (1), context);
+        }
+    }
+
+    void reduce (const IntermediateVec *pairs, void *context) const override
+    {
+      unsigned int key = static_cast<IntKey *> (pairs->at (0).first)->key;
+      for (const IntermediatePair &pair : *pairs)
+        {
+          delete pair.first;
+          delete pair.second;
+        }
+      emit3 (new IntKey (key), new Count ((unsigned int) pairs->size ()), context);
+    }
+
+    unsigned int cardinality;
+    bool skewed;
+};
+
+/**
+ * documents of WORDS_PER_DOC words, drawn uniformly from cardinality words.
+ */
+static void make_documents (InputVec *inputVec, int inputSize, unsigned int cardinality)
+{
+  unsigned int x = 1;
+  for (int doc = 0; doc < inputSize / WORDS_PER_DOC; ++doc)
+    {
+      std::string text;
+      for (int i = 0; i < WORDS_PER_DOC; ++i)
+        {
+          text += "w" + std::to_string (next_random (&x) % cardinality) + " ";
+        }
+      inputVec->push_back (InputPair (new DocId ((unsigned int) doc), new Document (text)));
+    }
+}
+
+static void make_seeds (InputVec *inputVec, int inputSize)
+{
+  for (int i = 0; i < inputSize / KEYS_PER_INPUT; ++i)
+    {
+      inputVec->push_back (InputPair (nullptr, new Seed ((unsigned int) i + 1)));
+    }
+}
+
+static void delete_input (InputVec *inputVec)
+{
+  for (InputPair &pair : *inputVec)
+    {
+      delete pair.first;
+      delete pair.second;
+    }
+}
+
+static void delete_output (OutputVec *outputVec)
+{
+  for (OutputPair &pair : *outputVec)
+    {
+      delete pair.first;
+      delete pair.second;
+    }
+}
+
+static long peak_rss_kb ()
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * runs one job of a workload and prints its line.
+ */
+static void runWorkload (const std::string &workload, int inputSize, unsigned int cardinality,
+                         int threads, shuffle_t shuffle, const char *shuffleName)
+{
+  InputVec inputVec;
+  OutputVec outputVec;
+  WordCountClient wordCount;
+  InvertedIndexClient invertedIndex;
+  CountKeysClient skew (cardinality, true);
+  CountKeysClient sort (cardinality, false);
+  const MapReduceClient *client;
+  JobConfig config;
+  config.shuffle = shuffle;
+  if (workload == "wordcount")
+    {
+      client = &wordCount;
+      config.hooks = &wordCount;
+      make_documents (&inputVec, inputSize, cardinality);
+    }
+  else if (workload == "index")
+    {
+      client = &invertedIndex;
+      config.hooks = &invertedIndex;
+      make_documents (&inputVec, inputSize, cardinality);
+    }
+  else if (workload == "skew")
+    {
+      client = &skew;
+      config.hooks = &skew;
+      make_seeds (&inputVec, inputSize);
+    }
+  else
+    {
+      client = &sort;
+      config.hooks = &sort;
+      config.orderedOutput = shuffle == MERGE_SHUFFLE || shuffle == SAMPLE_SHUFFLE;
+      make_seeds (&inputVec, inputSize);
+    }
+  long inputRss = peak_rss_kb ();
+
+  Clock::time_point start = Clock::now ();
+  JobHandle job = startMapReduceJob (*client, inputVec, outputVec, threads, config);
+  waitForJob (job);
+  double totalMs = std::chrono::duration<double, std::milli> (Clock::now () - start).count ();
+  JobStats stats;
+  getJobStats (job, &stats);
+  closeJobHandle (job);
+  long peakRss = peak_rss_kb ();
+
+  ThreadStats longest = ThreadStats ();
+  uint64_t pairs = 0;
+  for (const ThreadStats &thread : stats.threads)
+    {
+      longest.mapNs = std::max (longest.mapNs, thread.mapNs);
+      longest.sortNs = std::max (longest.sortNs, thread.sortNs);
+      longest.barrierNs = std::max (longest.barrierNs, thread.barrierNs);
+      longest.shuffleNs = std::max (longest.shuffleNs, thread.shuffleNs);
+      longest.reduceNs = std::max (longest.reduceNs, thread.reduceNs);
+      pairs += thread.pairsEmitted;
+    }
+  printf ("%s,%s,%d,%d,%u,%llu,%zu,%.3f,%.0f,%.3f,%.3f,%.3f,%.3f,%.3f,%ld,%ld\n",
+          workload.c_str (), shuffleName, threads, inputSize, cardinality,
+          (unsigned long long) pairs, outputVec.size (), totalMs, pairs / (totalMs / 1000),
+          longest.mapNs / 1e6, longest.sortNs / 1e6, longest.barrierNs / 1e6,
+          longest.shuffleNs / 1e6, longest.reduceNs / 1e6, inputRss, peakRss);
+  fflush (stdout);
+
+  delete_output (&outputVec);
+  delete_input (&inputVec);
+}
+
+int main (int argc, char **argv)
+{
+  const char *workloads[] = {"wordcount", "index", "skew", "sort"};
+  const char *shuffleNames[] = {"merge", "hash", "pipelined", "sample"};
+  std::string workload = argc > 1 ? argv[1] : "all";
+  int inputSize = argc > 2 ? atoi (argv[2]) : DEFAULT_INPUT_SIZE;
+  unsigned int cardinality = argc > 3 ? (unsigned int) atoi (argv[3]) : DEFAULT_CARDINALITY;
+  int threads = argc > 4 ? atoi (argv[4]) : 0;
+  int shuffle = argc > 5 ? -1 : MERGE_SHUFFLE;
+  for (int i = 0; argc > 5 && i < 4; ++i)
+    {
+      if (strcmp (argv[5], shuffleNames[i]) == 0)
+        {
+          shuffle = i;
+        }
+    }
+  bool known = workload == "all" && shuffle >= 0;
+  for (const char *name : workloads)
+    {
+      known = known || (workload == name && shuffle >= 0);
+    }
+  if (!known || inputSize <= 0 || cardinality == 0)
+    {
+      fprintf (stderr, "usage: mr_bench [wordcount|index|skew|sort|all] [input_size] [cardinality]"
+                       " [threads] [merge|hash|pipelined|sample]\n");
+      return 1;
+    }
+  std::vector<int> threadCounts;
+  if (threads > 0)
+    {
+      threadCounts.push_back (threads);
+    }
+  else
+    {
+      int maxThreads = std::max ((int) sysconf (_SC_NPROCESSORS_ONLN), 4);
+      for (int t = 1; t <= maxThreads; t *= 2)
+        {
+          threadCounts.push_back (t);
+        }
+    }
+
+  printf ("workload,shuffle,threads,input_size,cardinality,pairs,output_pairs,total_ms,"
+          "pairs_per_sec,map_ms,sort_ms,barrier_ms,shuffle_ms,reduce_ms,input_rss_kb,peak_rss_kb\n");
+  fflush (stdout);
+  for (const char *name : workloads)
+    {
+      if (workload != "all" && workload != name)
+        {
+          continue;
+        }
+      for (int t : threadCounts)
+        {
+          // a process per run, so the peak RSS of a run does not include the runs before it.
+          pid_t pid = fork ();
+          if (pid < 0)
+            {
+              fprintf (stderr, "mr_bench: fork failed\n");
+              return 1;
+            }
+          if (pid == 0)
+            {
+              runWorkload (name, inputSize, cardinality, t, (shuffle_t) shuffle, shuffleNames[shuffle]);
+              exit (0);
+            }
+          int status;
+          if (waitpid (pid, &status, 0) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+            {
+              fprintf (stderr, "mr_bench: the %s run with %d threads failed\n", name, t);
+              return 1;
+            }
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <unistd.h>
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+#include "JobConfig.h"
+#include "JobStats.h"
+
+/**
+ * Compares jobs with pinned threads (JobConfig::pinThreads) against jobs with free threads.
+ * usage: numa_bench [num_pairs] [threads]
+ * threads defaults to the number of online cpus. Every configuration runs REPEATS times and the
+ * fastest run is printed: the time of the whole job, and the longest time a thread spent in
+ * the shuffle (from getJobStats). Pinning helps the shuffle of HASH_SHUFFLE and SAMPLE_SHUFFLE
+ * only; MERGE_SHUFFLE merges on thread 0 whether pinned or not, so its shuffle_ms is the
+ * baseline and only its map and sort time can gain.
+ */
+
+#define DEFAULT_NUM_PAIRS 4000000
+#define PAIRS_PER_INPUT 1000
+#define CARDINALITY 100000
+#define REPEATS 3
+
+typedef std::chrono::steady_clock Clock;
+
+class IntKey : public K2, public K3 {
+public:
+    explicit IntKey (unsigned int key) : key (key) {}
+    bool operator< (const K2 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    bool operator< (const K3 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    unsigned int key;
+};
+
+class Count : public V2, public V3 {
+public:
+    explicit Count (unsigned int count) : count (count) {}
+    unsigned int count;
+};
+
+class Seed : public V1 {
+public:
+    explicit Seed (unsigned int seed) : seed (seed) {}
+    unsigned int seed;
+};
+
+/**
+ * every input emits PAIRS_PER_INPUT pairs with pseudo random keys in [0, CARDINALITY).
+ */
+class BenchClient : public MapReduceClient, public ClientHooks {
+public:
+    void map (const K1 *key, const V1 *value, void *context) const override
+    {
+      unsigned int x = static_cast<const Seed *> (value)->seed;
+      for (int i = 0; i < PAIRS_PER_INPUT; ++i)
+        {
+          x = x * 1103515245 + 12345;
+          emit2 (new IntKey ((x >> 8) % CARDINALITY), new Count (1), context);
+        }
+    }
+
+    void reduce (const IntermediateVec *pairs, void *context) const override
+    {
+      unsigned int key = static_cast<IntKey *> (pairs->at (0).first)->key;
+      for (const IntermediatePair &pair : *pairs)
+        {
+          delete pair.first;
+          delete pair.second;
+        }
+      emit3 (new IntKey (key), new Count ((unsigned int) pairs->size ()), context);
+    }
+
+    uint64_t hashKey (const K2 *key) const override
+    {
+      return static_cast<const IntKey *> (key)->key * 2654435761u;
+    }
+};
+
+/**
+ * runs one job.
+ * @param totalMs the time of the whole job in milliseconds.
+ * @param shuffleMs the longest shuffle time of a thread in milliseconds.
+ */
+void runJob (const JobConfig &config, int threads, int numPairs, double *totalMs, double *shuffleMs)
+{
+  BenchClient client;
+  InputVec inputVec;
+  OutputVec outputVec;
+  for (int i = 0; i < numPairs / PAIRS_PER_INPUT; ++i)
+    {
+      inputVec.push_back (InputPair (nullptr, new Seed (i + 1)));
+    }
+
+  Clock::time_point start = Clock::now ();
+  JobHandle job = startMapReduceJob (client, inputVec, outputVec, threads, config);
+  waitForJob (job);
+  *totalMs = std::chrono::duration<double, std::milli> (Clock::now () - start).count ();
+  JobStats stats;
+  getJobStats (job, &stats);
+  uint64_t shuffleNs = 0;
+  for (const ThreadStats &thread : stats.threads)
+    {
+      shuffleNs = std::max (shuffleNs, thread.shuffleNs);
+    }
+  *shuffleMs = shuffleNs / 1e6;
+  closeJobHandle (job);
+
+  for (OutputPair &pair : outputVec)
+    {
+      delete pair.first;
+      delete pair.second;
+    }
+  for (InputPair &pair : inputVec)
+    {
+      delete pair.second;
+    }
+}
+
+int main (int argc, char **argv)
+{
+  int numPairs = argc > 1 ? atoi (argv[1]) : DEFAULT_NUM_PAIRS;
+  int threads = argc > 2 ? atoi (argv[2]) : (int) sysconf (_SC_NPROCESSORS_ONLN);
+  const shuffle_t shuffles[] = {MERGE_SHUFFLE, HASH_SHUFFLE, SAMPLE_SHUFFLE};
+  const char *names[] = {"merge", "hash", "pipelined", "sample"};
+  BenchClient hooks;
+
+  printf ("shuffle,pinned,threads,pairs,total_ms,shuffle_ms\n");
+  for (shuffle_t shuffle : shuffles)
+    {
+      for (int pinned = 0; pinned < 2; ++pinned)
+        {
+          JobConfig config;
+          config.shuffle = shuffle;
+          config.hooks = &hooks;
+          config.pinThreads = pinned != 0;
+          double bestTotal = 0;
+          double bestShuffle = 0;
+          for (int i = 0; i < REPEATS; ++i)
+            {
+              double totalMs, shuffleMs;
+              runJob (config, threads, numPairs, &totalMs, &shuffleMs);
+              if (i == 0 || totalMs < bestTotal)
+                {
+                  bestTotal = totalMs;
+                  bestShuffle = shuffleMs;
+                }
+            }
+          printf ("%s,%d,%d,%d,%.3f,%.3f\n", names[shuffle], pinned, threads, numPairs,
+                  bestTotal, bestShuffle);
+          fflush (stdout);
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "MapReduceFramework.h"
+#include "MapReduceClient.h"
+#include "JobStats.h"
+
+/**
+ * Measures how long the shuffle phase takes for different thread counts and key cardinalities.
+ * usage: shuffle_bench [num_pairs]
+ * The shuffle time is the largest shuffleNs of the threads of the job (see getJobStats), read
+ * after waitForJob, so the main thread does not compete with the workers for a core. It counts
+ * the grouping itself, not the barriers around it.
+ */
+
+#define DEFAULT_NUM_PAIRS 1000000
+#define PAIRS_PER_INPUT 1000
+
+class IntKey : public K2, public K3 {
+public:
+    explicit IntKey (unsigned int key) : key (key) {}
+    bool operator< (const K2 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    bool operator< (const K3 &other) const override
+    { return key < static_cast<const IntKey &> (other).key; }
+    unsigned int key;
+};
+
+class Count : public V2, public V3 {
+public:
+    explicit Count (unsigned int count) : count (count) {}
+    unsigned int count;
+};
+
+class Seed : public V1 {
+public:
+    explicit Seed (unsigned int seed) : seed (seed) {}
+    unsigned int seed;
+};
+
+/**
+ * every input emits PAIRS_PER_INPUT pairs with pseudo random keys in [0, cardinality).
+ */
+class BenchClient : public MapReduceClient {
+public:
+    explicit BenchClient (unsigned int cardinality) : cardinality (cardinality) {}
+
+    void map (const K1 *key, const V1 *value, void *context) const override
+    {
+      unsigned int x = static_cast<const Seed *> (value)->seed;
+      for (int i = 0; i < PAIRS_PER_INPUT; ++i)
+        {
+          x = x * 1103515245 + 12345;
+          emit2 (new IntKey ((x >> 8) % cardinality), new Count (1), context);
+        }
+    }
+
+    void reduce (const IntermediateVec *pairs, void *context) const override
+    {
+      unsigned int key = static_cast<IntKey *> (pairs->at (0).first)->key;
+      for (const IntermediatePair &pair : *pairs)
+        {
+          delete pair.first;
+          delete pair.second;
+        }
+      emit3 (new IntKey (key), new Count ((unsigned int) pairs->size ()), context);
+    }
+
+    unsigned int cardinality;
+};
+
+/**
+ * runs one job and returns the shuffle time in milliseconds.
+ */
+double runJob (int threads, unsigned int cardinality, int numPairs)
+{
+  BenchClient client (cardinality);
+  InputVec inputVec;
+  OutputVec outputVec;
+  for (int i = 0; i < numPairs / PAIRS_PER_INPUT; ++i)
+    {
+      inputVec.push_back (InputPair (nullptr, new Seed (i + 1)));
+    }
+
+  JobHandle job = startMapReduceJob (client, inputVec, outputVec, threads);
+  waitForJob (job);
+  JobStats stats;
+  getJobStats (job, &stats);
+  uint64_t shuffleNs = 0;
+  for (const ThreadStats &thread : stats.threads)
+    {
+      shuffleNs = std::max (shuffleNs, thread.shuffleNs);
+    }
+  closeJobHandle (job);
+
+  for (OutputPair &pair : outputVec)
+    {
+      delete pair.first;
+      delete pair.second;
+    }
+  for (InputPair &pair : inputVec)
+    {
+      delete pair.second;
+    }
+  return shuffleNs / 1e6;
+}
+
+int main (int argc, char **argv)
+{
+  int numPairs = argc > 1 ? atoi (argv[1]) : DEFAULT_NUM_PAIRS;
+  const int threadCounts[] = {1, 2, 4, 8, 16, 32, 64};
+  const unsigned int cardinalities[] = {10, 1000, 100000};
+
+  printf ("threads,cardinality,pairs,shuffle_ms\n");
+  for (unsigned int cardinality : cardinalities)
+    {
+      for (int threads : threadCounts)
+        {
+          double ms = runJob (threads, cardinality, numPairs);
+          printf ("%d,%u,%d,%.3f\n", threads, cardinality, numPairs, ms);
+          fflush (stdout);
+        }
+    }
+  return 0;
+}